@@ -0,0 +1,69 @@
+#!/usr/bin/ruby
+
+# compares two result files written by bin/bench/macro:
+#
+#   benchcmp.rb [-t <percent>] <old.json> <new.json>
+#
+# prints old and new values of every benchmark both have, and flags whatever got worse
+# by more than <percent> (default: 10). exits with 1 if anything did, so it can gate a build.
+
+require "json"
+require "optparse"
+
+METRICS = [
+  # name, what it's called in the json, and whether more is better
+  ["wall", "wall_s", false],
+  ["rss", "peak_rss_kb", false],
+  ["syscalls", "syscalls", false],
+  ["allocs", "allocations", false],
+]
+
+def load(path)
+  data = JSON.parse(File.read(path))
+  res = {}
+  data["results"].each do |r|
+    res[[r["tree"], r["bench"], r["cache"]]] = r
+  end
+  return [data, res]
+end
+
+begin
+  threshold = 10.0
+  OptionParser.new{|prs|
+    prs.banner = "usage: benchcmp.rb [-t <percent>] <old.json> <new.json>"
+    prs.on("-t<n>", "--threshold=<n>", "how much worse counts as a regression, in percent"){|v|
+      threshold = v.to_f
+    }
+  }.parse!
+  if ARGV.size != 2 then
+    $stderr.puts("need exactly two result files (-h for help)")
+    exit(2)
+  end
+  olddata, oldres = load(ARGV[0])
+  newdata, newres = load(ARGV[1])
+  if olddata["trees"].map{|t| t["shape"] } != newdata["trees"].map{|t| t["shape"] } then
+    $stderr.puts("warning: the trees differ, so the numbers may not be comparable")
+  end
+  printf("%s (%s) -> %s (%s)\n", ARGV[0], olddata["commit"], ARGV[1], newdata["commit"])
+  regressions = 0
+  newres.each do |key, nr|
+    orr = oldres[key]
+    next if orr.nil?
+    cols = []
+    worse = false
+    METRICS.each do |name, field, morebetter|
+      ov = orr[field]
+      nv = nr[field]
+      next if (ov.nil? || nv.nil? || (ov == 0))
+      pct = (((nv - ov).to_f / ov) * 100.0)
+      pct = -pct if morebetter
+      bad = (pct > threshold)
+      worse ||= bad
+      cols.push(sprintf("%s %s -> %s (%+.1f%%)%s", name, ov, nv, pct, (bad ? " !" : "")))
+    end
+    regressions += 1 if worse
+    printf("%s %-8s %-32s %s\n", (worse ? "!!" : "  "), key[0], key[1] + " [" + key[2] + "]", cols.join(", "))
+  end
+  printf("%d regression(s) over %.1f%%\n", regressions, threshold)
+  exit((regressions > 0) ? 1 : 0)
+end
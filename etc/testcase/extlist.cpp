@@ -0,0 +1,76 @@
+
+/*
+* checks Shared::ExtList on keys that countext actually produces, starting with an
+* empty one (the stem of a dotfile) before the arena has any block at all.
+*
+* build & run (from the top directory):
+*   g++ -std=c++17 -g -I src etc/testcase/extlist.cpp -o extlisttest && ./extlisttest
+*/
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "countkernels.h"
+
+static int g_failed = 0;
+
+static void check(bool ok, const char* what)
+{
+    if(!ok)
+    {
+        std::cerr << "FAILED: " << what << std::endl;
+        g_failed++;
+    }
+}
+
+static size_t countOf(Shared::ExtList& map, std::string_view key)
+{
+    for(const auto& it: map)
+    {
+        if(it.ext == key)
+        {
+            return it.count;
+        }
+    }
+    return 0;
+}
+
+int main()
+{
+    std::string longkey(1024 * 128, 'x');
+    {
+        // first key is empty
+        Shared::ExtList map;
+        map.increase("");
+        map.increase("");
+        map.increase(".c");
+        check(map.size() == 2, "empty first key: two distinct keys");
+        check(countOf(map, "") == 2, "empty first key: counted twice");
+        check(countOf(map, ".c") == 1, "empty first key: later key stored");
+    }
+    {
+        // the same, the way 'countext -m s' gets there
+        Shared::ExtList map;
+        Shared::countStem(map, "dir/.bashrc", false);
+        Shared::countStem(map, "dir/.profile", true);
+        Shared::countStem(map, "dir/Foo.c", true);
+        check(countOf(map, "") == 2, "dotfile stems: counted as empty");
+        check(countOf(map, "foo") == 1, "dotfile stems: lowercased stem");
+    }
+    {
+        // a key longer than an arena block, before and after small ones
+        Shared::ExtList map;
+        map.increase(longkey);
+        map.increase("");
+        map.increase(".h");
+        map.increase(longkey);
+        check(countOf(map, longkey) == 2, "long first key: counted twice");
+        check(countOf(map, ".h") == 1, "long first key: small key after it");
+    }
+    if(g_failed > 0)
+    {
+        return EXIT_FAILURE;
+    }
+    std::cout << "all good" << std::endl;
+    return EXIT_SUCCESS;
+}
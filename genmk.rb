@@ -4,7 +4,7 @@
 
 DEF_CXX    = %w(g++ -std=c++17 -O3)
 DEF_WFLAGS = %w(-Wall -Wextra)
-DEF_CFLAGS = %w(-g3 -ggdb3)
+DEF_CFLAGS = %w(-g3 -ggdb3 -pthread)
 DEF_LFLAGS = %w()
 
 
@@ -57,6 +57,8 @@ end
 
 begin
   sharedobjects = []
+  programs = []
+  benchmarks = []
   cflags = DEF_CFLAGS.dup
   lflags = DEF_LFLAGS.dup
   wflags = DEF_WFLAGS.dup
@@ -85,7 +87,17 @@ begin
       exe = File.basename(srcfile).gsub(/\.cpp$/, "")
       ofile = print_buildrule(out, srcfile)
       out.printf("build bin/%s: link %s\n", exe, [ofile, sharedobjects].join(" "))
+      programs.push("bin/" + exe)
     end
+    # benchmarks are only built by 'ninja bench'
+    getglobs(/\.cpp$/, "src/bench") do |srcfile|
+      exe = File.basename(srcfile).gsub(/\.cpp$/, "")
+      ofile = print_buildrule(out, srcfile)
+      out.printf("build bin/bench/%s: link %s\n", exe, [ofile, sharedobjects].join(" "))
+      benchmarks.push("bin/bench/" + exe)
+    end
+    out.printf("build bench: phony %s\n", benchmarks.join(" "))
+    out.printf("default %s\n", programs.join(" "))
   end
 end
 
@@ -21,12 +21,50 @@
 #include <iostream>
 #include <sstream>
 #include <exception>
+#include <system_error>
 #include <utility>
 #include <vector>
 #include <map>
 #include <algorithm>
 #include <functional>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <unordered_map>
+#include <optional>
+#include <string_view>
+#include <memory>
+#include <chrono>
+#include <string>
 #include <cwchar>
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include "findrules.hpp"
+#include "findtrace.hpp"
+
+#if defined(__linux__)
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <dirent.h>
+    #include <sys/stat.h>
+    #include <sys/syscall.h>
+    #include <sys/sysmacros.h>
+    #if __has_include(<linux/io_uring.h>)
+        #include "finduring.hpp"
+        #define FIND_HAVE_URING 1
+    #endif
+#endif
+
+/*
+* the walker counts what it does (see Find::WalkStats, and Finder::stats()).
+* building with FIND_STATS=0 compiles all of that out.
+*/
+#if !defined(FIND_STATS)
+    #define FIND_STATS 1
+#endif
 
 /*
 * these are necessary for platforms that may not support std::filesystem.
@@ -89,277 +127,2163 @@
 
 namespace Find
 {
-    class Finder
+    /*
+    * the parts of stat(2) the walker passes on, if asked to (see Finder::Config::want_stat).
+    * like std::filesystem::status(), this describes what a symlink points to, not
+    * the symlink itself.
+    */
+    struct StatInfo
+    {
+        uint64_t size = 0;
+
+        // modification time, in nanoseconds since the epoch
+        int64_t mtime = 0;
+
+        // the space actually taken up on disk (st_blocks * 512), which may be less than $size for sparse files
+        uint64_t allocated = 0;
+
+        /*
+        * device and inode number, which identify hard links to the same file.
+        * both are 0 where they aren't known (i.e., anywhere but POSIX systems).
+        */
+        uint64_t dev = 0;
+        uint64_t ino = 0;
+
+        // the number of hard links to the file (0 if not known)
+        uint32_t nlink = 0;
+    };
+
+    /*
+    * what a walk did, as returned by Finder::stats().
+    * the counters are kept per thread, and added up once the walk is done; the times
+    * are added up over all threads as well, so with more than one, they can add up
+    * to more than $ns_walk.
+    */
+    struct WalkStats
+    {
+        // the number of threads that walked
+        size_t threads = 0;
+
+        // directories that were opened and read, and directories that were replayed from a DirIndex instead
+        uint64_t dirs_opened = 0;
+        uint64_t dirs_reused = 0;
+
+        // entries found in those directories, before anything got to skip them
+        uint64_t entries = 0;
+
+        // stat(), lstat() and fstatat() calls, and statx() requests that went through an io_uring
+        uint64_t stat_calls = 0;
+        uint64_t statx_batched = 0;
+
+        // directories that weren't descended into because a rule or a callback said so
+        uint64_t pruned = 0;
+
+        /*
+        * directories that couldn't be opened or read, entries that couldn't be stat'd, and
+        * exceptions thrown by callbacks - everything that was reported (see Finder::onError()).
+        */
+        uint64_t errors = 0;
+
+        // bytes of paths that had to be allocated: std::filesystem::paths, and queued directories
+        uint64_t path_bytes = 0;
+
+        /*
+        * nanoseconds spent opening directories, reading them (including stat'ing their entries),
+        * in callbacks (including the rules and ignore files), and idling in the parallel
+        * walker for lack of work. only measured if Config::time_stats is set.
+        */
+        uint64_t ns_open = 0;
+        uint64_t ns_read = 0;
+        uint64_t ns_callbacks = 0;
+        uint64_t ns_idle = 0;
+
+        // the wall time of the walk
+        uint64_t ns_walk = 0;
+
+        void merge(const WalkStats& other)
+        {
+            threads = std::max(threads, other.threads);
+            dirs_opened += other.dirs_opened;
+            dirs_reused += other.dirs_reused;
+            entries += other.entries;
+            stat_calls += other.stat_calls;
+            statx_batched += other.statx_batched;
+            pruned += other.pruned;
+            errors += other.errors;
+            path_bytes += other.path_bytes;
+            ns_open += other.ns_open;
+            ns_read += other.ns_read;
+            ns_callbacks += other.ns_callbacks;
+            ns_idle += other.ns_idle;
+            ns_walk += other.ns_walk;
+        }
+    };
+
+    namespace Detail
+    {
+        /*
+        * a directory that is waiting to be read by the parallel walker,
+        * along with the depth it was found at (the start directories are depth 0).
+        */
+        struct WalkItem
+        {
+            std::filesystem::path dir;
+            size_t depth = 0;
+
+            // the ignore files that apply to $dir. see Finder::setIgnoreFiles()
+            IgnoreScope::Ptr scope;
+
+            /*
+            * the device of the directory $dir was found in (0 for the start directories),
+            * if Config::one_filesystem or Config::mount_budget need to know it.
+            */
+            uint64_t device = 0;
+
+            // set for directories that were put off for being on a slow mount; see Config::mount_budget
+            bool deferred = false;
+        };
+
+        /*
+        * the counters of one walker thread, so that counting never needs to be atomic;
+        * aligned, so that neighbouring threads don't share a cache line.
+        * the times are only taken if $timed - a clock read costs more than all the counting.
+        * with FIND_STATS=0, this is empty, and every call to it does nothing.
+        */
+        class alignas(64) StatsShard
+        {
+            public:
+                using Clock = std::chrono::steady_clock;
+
+                enum class Phase
+                {
+                    Open,
+                    // the whole directory: opening, reading, and the callbacks
+                    Scan,
+                    Callbacks,
+                    Idle,
+                };
+
+            #if FIND_STATS
+            private:
+                WalkStats m_data;
+                uint64_t m_scanns = 0;
+                bool m_timed = false;
+            #endif
+
+            public:
+                void reset(bool timed)
+                {
+                    #if FIND_STATS
+                        m_data = WalkStats{};
+                        m_scanns = 0;
+                        m_timed = timed;
+                    #else
+                        (void)timed;
+                    #endif
+                }
+
+                void count(uint64_t WalkStats::*field, uint64_t n=1)
+                {
+                    #if FIND_STATS
+                        m_data.*field += n;
+                    #else
+                        (void)field;
+                        (void)n;
+                    #endif
+                }
+
+                bool timed() const
+                {
+                    #if FIND_STATS
+                        return m_timed;
+                    #else
+                        return false;
+                    #endif
+                }
+
+                void addTime(Phase phase, Clock::duration took)
+                {
+                    #if FIND_STATS
+                        uint64_t ns;
+                        ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(took).count());
+                        switch(phase)
+                        {
+                            case Phase::Open:
+                                m_data.ns_open += ns;
+                                break;
+                            case Phase::Scan:
+                                m_scanns += ns;
+                                break;
+                            case Phase::Callbacks:
+                                m_data.ns_callbacks += ns;
+                                break;
+                            case Phase::Idle:
+                                m_data.ns_idle += ns;
+                                break;
+                        }
+                    #else
+                        (void)phase;
+                        (void)took;
+                    #endif
+                }
+
+                // adds this shard's counters to $dest; reading is whatever scanning wasn't opening or callbacks
+                void mergeInto(WalkStats& dest) const
+                {
+                    #if FIND_STATS
+                        WalkStats mine;
+                        mine = m_data;
+                        if(m_scanns > (mine.ns_open + mine.ns_callbacks))
+                        {
+                            mine.ns_read = (m_scanns - (mine.ns_open + mine.ns_callbacks));
+                        }
+                        dest.merge(mine);
+                    #else
+                        (void)dest;
+                    #endif
+                }
+        };
+
+        /*
+        * adds the time from its construction until stop() (or its destruction) to a phase
+        * of $shard - if the shard is timed at all.
+        */
+        class PhaseTimer
+        {
+            private:
+                StatsShard& m_shard;
+                StatsShard::Phase m_phase;
+                bool m_running;
+                StatsShard::Clock::time_point m_started;
+
+            public:
+                PhaseTimer(StatsShard& shard, StatsShard::Phase phase): m_shard(shard), m_phase(phase), m_running(shard.timed())
+                {
+                    if(m_running)
+                    {
+                        m_started = StatsShard::Clock::now();
+                    }
+                }
+
+                ~PhaseTimer()
+                {
+                    stop();
+                }
+
+                PhaseTimer(const PhaseTimer&) = delete;
+                PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+                void stop()
+                {
+                    if(m_running)
+                    {
+                        m_running = false;
+                        m_shard.addTime(m_phase, StatsShard::Clock::now() - m_started);
+                    }
+                }
+        };
+
+        /*
+        * the per-thread queue of pending directories.
+        * the owning thread pushes and pops at the back (so it walks depth-first,
+        * which keeps the directory cache warm), while idle threads steal from the front,
+        * which tends to hand out the large, not-yet-explored subtrees.
+        */
+        class WorkDeque
+        {
+            private:
+                std::mutex m_mutex;
+                std::deque<WalkItem> m_items;
+
+            public:
+                void push(WalkItem&& item)
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_items.push_back(std::move(item));
+                }
+
+                bool popBack(WalkItem& dest)
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if(m_items.empty())
+                    {
+                        return false;
+                    }
+                    dest = std::move(m_items.back());
+                    m_items.pop_back();
+                    return true;
+                }
+
+                bool stealFront(WalkItem& dest)
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if(m_items.empty())
+                    {
+                        return false;
+                    }
+                    dest = std::move(m_items.front());
+                    m_items.pop_front();
+                    return true;
+                }
+        };
+
+        /*
+        * the modification time of $path (following symlinks), in nanoseconds since the epoch.
+        */
+        inline bool pathMtime(const std::filesystem::path& path, int64_t& dest)
+        {
+            #if defined(__linux__)
+                struct stat st;
+                if(stat(path.c_str(), &st) != 0)
+                {
+                    return false;
+                }
+                dest = ((int64_t(st.st_mtim.tv_sec) * 1000000000) + st.st_mtim.tv_nsec);
+                return true;
+            #else
+                std::error_code ecode;
+                auto tm = std::filesystem::last_write_time(path, ecode);
+                if(ecode)
+                {
+                    return false;
+                }
+                dest = std::chrono::duration_cast<std::chrono::nanoseconds>(tm.time_since_epoch()).count();
+                return true;
+            #endif
+        }
+
+        /*
+        * the device $path (following symlinks) is on.
+        * only available on linux; returns false elsewhere.
+        */
+        inline bool pathDevice(const std::filesystem::path& path, uint64_t& dest)
+        {
+            #if defined(__linux__)
+                struct stat st;
+                if(stat(path.c_str(), &st) != 0)
+                {
+                    return false;
+                }
+                dest = st.st_dev;
+                return true;
+            #else
+                (void)path;
+                (void)dest;
+                return false;
+            #endif
+        }
+
+    #if defined(__linux__)
+        /*
+        * what getdents64(2) writes into its buffer. glibc only declares this
+        * (as struct dirent64) in recent versions, so it's spelled out here.
+        */
+        struct LinuxDirent64
+        {
+            uint64_t d_ino;
+            int64_t d_off;
+            unsigned short d_reclen;
+            unsigned char d_type;
+            char d_name[];
+        };
+
+        /* owns the file descriptor of a directory opened for getdents64 */
+        class DirHandle
+        {
+            private:
+                int m_fd;
+
+                // errno of the open(), if it failed
+                int m_error = 0;
+
+            public:
+                DirHandle(const std::filesystem::path& dir)
+                {
+                    m_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                    if(m_fd == -1)
+                    {
+                        m_error = errno;
+                    }
+                }
+
+                ~DirHandle()
+                {
+                    close();
+                }
+
+                DirHandle(const DirHandle&) = delete;
+                DirHandle& operator=(const DirHandle&) = delete;
+
+                bool good() const
+                {
+                    return (m_fd != -1);
+                }
+
+                int fd() const
+                {
+                    return m_fd;
+                }
+
+                int error() const
+                {
+                    return m_error;
+                }
+
+                void close()
+                {
+                    if(m_fd != -1)
+                    {
+                        ::close(m_fd);
+                        m_fd = -1;
+                    }
+                }
+        };
+
+        /*
+        * the buffer getdents64 reads into. one per thread, reused for every directory.
+        * 128K holds a couple thousand entries, so most directories are read in one go.
+        */
+        inline std::vector<char>& getdentsBuffer()
+        {
+            static thread_local std::vector<char> buf(1024 * 128);
+            return buf;
+        }
+
+        inline bool isDotOrDotDot(const char* name)
+        {
+            return ((name[0] == '.') && ((name[1] == 0) || ((name[1] == '.') && (name[2] == 0))));
+        }
+
+        /*
+        * figures out what a directory entry is, using d_type if possible.
+        * the results follow symlinks, just like std::filesystem::status() does.
+        * dangling symlinks are neither files nor directories.
+        * the fstatat() calls this needed are counted in $stats.
+        */
+        inline void classifyDirent(int dirfd, const LinuxDirent64* ent, bool& isdir, bool& isfile, bool& islink, StatsShard& stats)
+        {
+            struct stat st;
+            unsigned char dtype;
+            isdir = false;
+            isfile = false;
+            islink = false;
+            dtype = ent->d_type;
+            if(dtype == DT_UNKNOWN)
+            {
+                stats.count(&WalkStats::stat_calls);
+                if(fstatat(dirfd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                {
+                    return;
+                }
+                dtype = IFTODT(st.st_mode);
+            }
+            if(dtype == DT_LNK)
+            {
+                islink = true;
+                stats.count(&WalkStats::stat_calls);
+                if(fstatat(dirfd, ent->d_name, &st, 0) != 0)
+                {
+                    return;
+                }
+                dtype = IFTODT(st.st_mode);
+            }
+            isdir = (dtype == DT_DIR);
+            isfile = (dtype == DT_REG);
+        }
+
+        inline void fillStatInfo(const struct stat& st, StatInfo& dest)
+        {
+            dest.size = st.st_size;
+            dest.mtime = ((int64_t(st.st_mtim.tv_sec) * 1000000000) + st.st_mtim.tv_nsec);
+            dest.allocated = (uint64_t(st.st_blocks) * 512);
+            dest.dev = st.st_dev;
+            dest.ino = st.st_ino;
+            dest.nlink = st.st_nlink;
+        }
+
+    #if defined(FIND_HAVE_URING)
+        /* statDirent(), for an entry whose statx() went through the ring already */
+        inline bool statxDirent(const LinuxDirent64* ent, const StatxRing::Request& req, bool& isdir, bool& isfile, bool& islink, StatInfo& dest)
+        {
+            const struct statx& stx = req.stx;
+            isdir = false;
+            isfile = false;
+            islink = (ent->d_type == DT_LNK);
+            if(req.result != 0)
+            {
+                return false;
+            }
+            isdir = S_ISDIR(stx.stx_mode);
+            isfile = S_ISREG(stx.stx_mode);
+            dest.size = stx.stx_size;
+            dest.mtime = ((int64_t(stx.stx_mtime.tv_sec) * 1000000000) + stx.stx_mtime.tv_nsec);
+            dest.allocated = (uint64_t(stx.stx_blocks) * 512);
+            dest.dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+            dest.ino = stx.stx_ino;
+            dest.nlink = stx.stx_nlink;
+            return true;
+        }
+    #endif
+
+        /*
+        * like classifyDirent(), but for when the caller wants the stat data anyway:
+        * every entry costs exactly one fstatat() (two for symlinks on filesystems
+        * that don't fill in d_type), and d_type is only used to tell symlinks apart.
+        * returns false if the entry couldn't be stat'd (i.e., dangling symlinks).
+        */
+        inline bool statDirent(int dirfd, const LinuxDirent64* ent, bool& isdir, bool& isfile, bool& islink, StatInfo& dest, StatsShard& stats)
+        {
+            struct stat st;
+            isdir = false;
+            isfile = false;
+            islink = (ent->d_type == DT_LNK);
+            if(ent->d_type == DT_UNKNOWN)
+            {
+                stats.count(&WalkStats::stat_calls);
+                if(fstatat(dirfd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                {
+                    return false;
+                }
+                islink = S_ISLNK(st.st_mode);
+            }
+            if((ent->d_type != DT_UNKNOWN) || islink)
+            {
+                stats.count(&WalkStats::stat_calls);
+                if(fstatat(dirfd, ent->d_name, &st, 0) != 0)
+                {
+                    return false;
+                }
+            }
+            isdir = S_ISDIR(st.st_mode);
+            isfile = S_ISREG(st.st_mode);
+            fillStatInfo(st, dest);
+            return true;
+        }
+    #endif
+
+        /*
+        * fills $dest for $path (following symlinks) - with a single stat() where available.
+        * elsewhere, only the size (of regular files) and mtime are known.
+        */
+        inline bool statPath(const std::filesystem::path& path, StatInfo& dest)
+        {
+            #if defined(__linux__)
+                struct stat st;
+                if(stat(path.c_str(), &st) != 0)
+                {
+                    return false;
+                }
+                fillStatInfo(st, dest);
+                return true;
+            #else
+                std::error_code ecode;
+                dest = StatInfo{};
+                if(std::filesystem::is_regular_file(path, ecode))
+                {
+                    dest.size = std::filesystem::file_size(path, ecode);
+                    dest.allocated = dest.size;
+                }
+                return pathMtime(path, dest.mtime);
+            #endif
+        }
+    }
+
+    /*
+    * a persistent record of what the walker found in every directory it read, so that
+    * a later walk of the same tree can skip reading directories that haven't changed.
+    *
+    * a directory is considered unchanged if its mtime is still what it was when it
+    * was listed. this is what adding, removing or renaming an entry changes - but not
+    * writing to a file that's already there, so sizes of files that were modified
+    * in place are only picked up again once something else in their directory changes.
+    *
+    * directories are keyed by their path as the walker saw it, i.e., walking "foo"
+    * and then "./foo" won't share any entries.
+    * lookups are lock-free (the previous index is read-only during a walk), storing
+    * takes a mutex.
+    */
+    class DirIndex
     {
         public:
-            using PruneIfFunc     = std::function<bool(const std::filesystem::path&)>;
-            using SkipFunc        = std::function<bool(const std::filesystem::path&,bool,bool)>;
-            using IgnoreFileFunc  = std::function<bool(const std::filesystem::path&)>;
-            using EachFunc        = std::function<void(const std::filesystem::path&)>;
-            using ExceptionFunc   = std::function<void(
-                std::runtime_error&,
-                const std::string&,
-                const std::filesystem::path&
-            )>;
+            enum
+            {
+                FlagIsDir   = (1 << 0),
+                FlagIsFile  = (1 << 1),
+                FlagIsLink  = (1 << 2),
+                FlagHasStat = (1 << 3),
+            };
 
-            struct Config
+            struct IndexedEntry
             {
-                bool use_dircache = false;
-                size_t max_depth = 0;
+                // offset of the (NUL-terminated) name in IndexedDir::names
+                uint32_t nameofs;
+                uint8_t flags;
+                StatInfo stat;
             };
 
-        public:
-            static bool DirectoryIs(const std::filesystem::path& input, const std::filesystem::path& findme)
+            /*
+            * the unfiltered contents of one directory, as read from disk - what's
+            * skipped, pruned or ignored is decided anew on every walk.
+            */
+            struct IndexedDir
             {
-                auto filename = input.filename();
-                return filename == findme;
+                // nanoseconds since the epoch
+                int64_t mtime = 0;
+
+                // whether the entries carry stat data, i.e., whether it was listed with want_stat
+                bool hasstat = false;
+
+                // false if reading the directory failed halfway through; such listings aren't kept
+                bool complete = true;
+
+                std::string names;
+                std::vector<IndexedEntry> entries;
+
+                void add(const std::string& name, bool isdir, bool isfile, bool islink, bool hasst, const StatInfo& stat)
+                {
+                    IndexedEntry ie;
+                    ie.nameofs = names.size();
+                    ie.flags = ((isdir ? FlagIsDir : 0) | (isfile ? FlagIsFile : 0) | (islink ? FlagIsLink : 0) | (hasst ? FlagHasStat : 0));
+                    ie.stat = stat;
+                    names.append(name);
+                    names.push_back(0);
+                    entries.push_back(ie);
+                }
+
+                const char* nameOf(const IndexedEntry& ie) const
+                {
+                    return (names.data() + ie.nameofs);
+                }
+            };
+
+            using DirPtr = std::shared_ptr<const IndexedDir>;
+
+        private:
+            static constexpr uint32_t Magic = 0x78646966;
+            static constexpr uint32_t Version = 3;
+
+            /*
+            * a directory that changed within this many nanoseconds before the index was
+            * written may have changed again without its mtime moving (on filesystems
+            * with coarse timestamps), so it is re-read regardless.
+            */
+            static constexpr int64_t RacyWindow = 2000000000;
+
+            // what was loaded. never modified during a walk
+            std::unordered_map<std::string, DirPtr> m_prev;
+            int64_t m_prevtime = 0;
+
+            // what this walk saw, which is what save() writes
+            std::unordered_map<std::string, DirPtr> m_next;
+            std::mutex m_nextmutex;
+            int64_t m_starttime;
+
+            std::atomic<size_t> m_reused;
+            std::atomic<size_t> m_rescanned;
+
+        private:
+            template<typename Type>
+            static void writeRaw(FILE* fh, const Type& val)
+            {
+                std::fwrite(&val, sizeof(Type), 1, fh);
             }
 
-            static bool DirectoryIs(const std::filesystem::path& input, const std::vector<std::filesystem::path>& items)
+            template<typename Type>
+            static bool readRaw(FILE* fh, Type& val)
             {
-                for(const auto& item: items)
+                return (std::fread(&val, sizeof(Type), 1, fh) == 1);
+            }
+
+            static bool readBytes(FILE* fh, std::string& dest, uint32_t len)
+            {
+                dest.resize(len);
+                return ((len == 0) || (std::fread(&dest[0], 1, len, fh) == len));
+            }
+
+            bool readFrom(FILE* fh)
+            {
+                uint32_t magic;
+                uint32_t version;
+                uint32_t len;
+                uint32_t count;
+                uint64_t ndirs;
+                uint64_t i;
+                uint32_t j;
+                uint8_t hasstat;
+                std::string key;
+                if(!(readRaw(fh, magic) && readRaw(fh, version) && (magic == Magic) && (version == Version)))
+                {
+                    return false;
+                }
+                if(!(readRaw(fh, m_prevtime) && readRaw(fh, ndirs)))
+                {
+                    return false;
+                }
+                m_prev.reserve(ndirs);
+                for(i=0; i<ndirs; i++)
+                {
+                    auto dir = std::make_shared<IndexedDir>();
+                    if(!(readRaw(fh, len) && readBytes(fh, key, len)))
+                    {
+                        return false;
+                    }
+                    if(!(readRaw(fh, dir->mtime) && readRaw(fh, hasstat) && readRaw(fh, len) && readBytes(fh, dir->names, len)))
+                    {
+                        return false;
+                    }
+                    if(!readRaw(fh, count))
+                    {
+                        return false;
+                    }
+                    dir->hasstat = (hasstat != 0);
+                    dir->entries.resize(count);
+                    for(j=0; j<count; j++)
+                    {
+                        auto& ie = dir->entries[j];
+                        if(!(readRaw(fh, ie.nameofs) && readRaw(fh, ie.flags) && readRaw(fh, ie.stat.size) && readRaw(fh, ie.stat.mtime)))
+                        {
+                            return false;
+                        }
+                        if(!(readRaw(fh, ie.stat.allocated) && readRaw(fh, ie.stat.dev) && readRaw(fh, ie.stat.ino) && readRaw(fh, ie.stat.nlink)))
+                        {
+                            return false;
+                        }
+                        if(ie.nameofs >= dir->names.size())
+                        {
+                            return false;
+                        }
+                    }
+                    m_prev.emplace(std::move(key), std::move(dir));
+                }
+                return true;
+            }
+
+        public:
+            static int64_t Now()
+            {
+                auto since = std::chrono::system_clock::now().time_since_epoch();
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(since).count();
+            }
+
+        public:
+            DirIndex(): m_starttime(Now()), m_reused(0), m_rescanned(0)
+            {
+            }
+
+            DirIndex(const DirIndex&) = delete;
+            DirIndex& operator=(const DirIndex&) = delete;
+
+            /*
+            * reads an index written by save().
+            * returns false if it doesn't exist, or is unusable (truncated, or written by
+            * a different version) - in which case the index is simply empty, and
+            * the next walk reads everything.
+            */
+            bool load(const std::string& path)
+            {
+                bool ok;
+                FILE* fh;
+                fh = std::fopen(path.c_str(), "rb");
+                if(fh == nullptr)
+                {
+                    return false;
+                }
+                std::setvbuf(fh, nullptr, _IOFBF, 1024 * 1024);
+                ok = readFrom(fh);
+                std::fclose(fh);
+                if(!ok)
+                {
+                    m_prev.clear();
+                    m_prevtime = 0;
+                }
+                return ok;
+            }
+
+            /*
+            * writes everything the walk(s) since construction saw to $path.
+            * the file is written under a temporary name first, and then renamed,
+            * so an interrupted save never leaves a broken index behind.
+            */
+            bool save(const std::string& path)
+            {
+                bool ok;
+                FILE* fh;
+                std::string tmppath;
+                tmppath = (path + ".tmp");
+                fh = std::fopen(tmppath.c_str(), "wb");
+                if(fh == nullptr)
+                {
+                    return false;
+                }
+                std::setvbuf(fh, nullptr, _IOFBF, 1024 * 1024);
+                writeRaw(fh, Magic);
+                writeRaw(fh, Version);
+                writeRaw(fh, m_starttime);
+                writeRaw(fh, uint64_t(m_next.size()));
+                for(const auto& it: m_next)
+                {
+                    const auto& dir = *it.second;
+                    writeRaw(fh, uint32_t(it.first.size()));
+                    std::fwrite(it.first.data(), 1, it.first.size(), fh);
+                    writeRaw(fh, dir.mtime);
+                    writeRaw(fh, uint8_t(dir.hasstat ? 1 : 0));
+                    writeRaw(fh, uint32_t(dir.names.size()));
+                    std::fwrite(dir.names.data(), 1, dir.names.size(), fh);
+                    writeRaw(fh, uint32_t(dir.entries.size()));
+                    for(const auto& ie: dir.entries)
+                    {
+                        writeRaw(fh, ie.nameofs);
+                        writeRaw(fh, ie.flags);
+                        writeRaw(fh, ie.stat.size);
+                        writeRaw(fh, ie.stat.mtime);
+                        writeRaw(fh, ie.stat.allocated);
+                        writeRaw(fh, ie.stat.dev);
+                        writeRaw(fh, ie.stat.ino);
+                        writeRaw(fh, ie.stat.nlink);
+                    }
+                }
+                ok = (std::ferror(fh) == 0);
+                ok = ((std::fclose(fh) == 0) && ok);
+                if(ok)
+                {
+                    ok = (std::rename(tmppath.c_str(), path.c_str()) == 0);
+                }
+                if(!ok)
+                {
+                    std::remove(tmppath.c_str());
+                }
+                return ok;
+            }
+
+            /*
+            * returns the stored listing of $dir if it can be used in place of reading it,
+            * that is, if its mtime hasn't changed, and it has stat data (if $wantstat).
+            */
+            DirPtr find(const std::string& dir, int64_t mtime, bool wantstat) const
+            {
+                auto it = m_prev.find(dir);
+                if(it == m_prev.end())
+                {
+                    return nullptr;
+                }
+                const auto& cached = *it->second;
+                if((cached.mtime != mtime) || (wantstat && !cached.hasstat))
+                {
+                    return nullptr;
+                }
+                if(mtime >= (m_prevtime - RacyWindow))
+                {
+                    return nullptr;
+                }
+                return it->second;
+            }
+
+            /*
+            * remembers the listing of $dir for save().
+            * $reused tells whether it came from find(), or was read from disk.
+            */
+            void store(const std::string& dir, DirPtr listing, bool reused)
+            {
+                if(reused)
+                {
+                    m_reused++;
+                }
+                else
+                {
+                    m_rescanned++;
+                }
+                std::lock_guard<std::mutex> lock(m_nextmutex);
+                m_next[dir] = std::move(listing);
+            }
+
+            // number of directories whose stored listing was used during this run
+            size_t reusedCount() const
+            {
+                return m_reused.load();
+            }
+
+            // number of directories that had to be read from disk during this run
+            size_t rescannedCount() const
+            {
+                return m_rescanned.load();
+            }
+    };
+
+    class Finder
+    {
+        public:
+            using PruneIfFunc     = std::function<bool(const std::filesystem::path&)>;
+            using SkipFunc        = std::function<bool(const std::filesystem::path&,bool,bool)>;
+            using IgnoreFileFunc  = std::function<bool(const std::filesystem::path&)>;
+            using EachFunc        = std::function<void(const std::filesystem::path&)>;
+            using DirDoneFunc     = std::function<void(const std::filesystem::path&,size_t,size_t)>;
+            using ExceptionFunc   = std::function<void(
+                std::runtime_error&,
+                const std::string&,
+                const std::filesystem::path&
+            )>;
+
+            /*
+            * where in the walk an error happened; see WalkError.
+            */
+            enum class ErrorPhase
+            {
+                // opening a directory (or finding out that it isn't one)
+                Open,
+
+                // reading the entries of a directory that was opened
+                Read,
+
+                // finding out what an entry is
+                Status,
+
+                // a prune callback threw
+                Prune,
+
+                // the walk callback threw
+                Callback,
+            };
+
+            /*
+            * what the error callback receives. these are plain values: nothing is thrown, and
+            * nothing is formatted or allocated unless the callback does so itself.
+            */
+            struct WalkError
+            {
+                // the errno value. 0 for an exception thrown by a callback that wasn't a filesystem_error
+                int code;
+
+                ErrorPhase phase;
+
+                // the directory it happened to; for Status, Prune and Callback, the entry
+                const std::filesystem::path& path;
+
+                // what() of the exception, if a callback threw one. null otherwise
+                const char* message;
+
+                // index of the thread that ran into it, like Entry::worker
+                size_t worker;
+            };
+
+            using ErrorFunc = std::function<void(const WalkError&)>;
+
+            /*
+            * how directories are read.
+            * Getdents and Uring are only available on linux; elsewhere they silently fall back
+            * to Standard.
+            */
+            enum class Backend
+            {
+                // std::filesystem::directory_iterator
+                Standard,
+
+                // raw getdents64(2), classifying entries by d_type
+                Getdents,
+
+                /*
+                * like Getdents, but with want_stat, the entries of each getdents batch are
+                * statx()'d through an io_uring, hundreds at a time, rather than one by one.
+                * if io_uring can't be set up (old kernel, or disabled), it is plain Getdents.
+                */
+                Uring,
+            };
+
+            struct Config
+            {
+                /*
+                * how deep to go, like find's -maxdepth: entries deeper than this are never
+                * reported, and directories at this depth are not opened (see Entry::depth).
+                * 0 means no limit.
+                */
+                size_t max_depth = 0;
+
+                /*
+                * number of threads used by walk().
+                * 1 (the default) walks on the calling thread only; anything above
+                * that uses the work-stealing walker, in which case all callbacks
+                * may be called concurrently, and must be thread-safe.
+                * 0 means "use as many threads as there are cores".
+                * never more than MaxThreads are used.
+                */
+                size_t threads = 1;
+
+                Backend backend = Backend::Standard;
+
+                /*
+                * whether to fill in Entry::stat for walkEntries().
+                * the getdents backend then stats every entry (once) instead of relying on d_type;
+                * the standard backend needs an extra stat() call for every file and directory.
+                */
+                bool want_stat = false;
+
+                /*
+                * names of .gitignore-style files to honor (see GitIgnore), like ".gitignore".
+                * empty (the default) turns ignore files off entirely.
+                */
+                std::vector<std::string> ignore_files;
+
+                /*
+                * don't read directories on a different device than the one they were found in,
+                * like 'find -xdev' and 'du -x'. mount points are still passed to the callback.
+                * costs a stat() per directory.
+                */
+                bool one_filesystem = false;
+
+                /*
+                * if not 0: once reading a single directory of a mount took longer than this,
+                * the rest of that mount is considered slow, and isn't read (see slowMounts()) -
+                * or, with $defer_slow_mounts, only read once everything else is done.
+                * also costs a stat() per directory, to find out which mount it's on.
+                */
+                std::chrono::milliseconds mount_budget{0};
+                bool defer_slow_mounts = false;
+
+                /*
+                * whether stats() should include the time spent per phase.
+                * costs two clock reads per entry, and a few more per directory; the counters
+                * themselves are always kept (unless built with FIND_STATS=0).
+                */
+                bool time_stats = false;
+
+                /*
+                * what errors do if there's neither an error callback nor an exception callback:
+                * by default, they're only counted (see WalkStats::errors). if set, the first one
+                * is thrown out of walk() as a std::filesystem::filesystem_error, ending the walk -
+                * which is what the walker used to do.
+                */
+                bool throw_errors = false;
+            };
+
+            /*
+            * what walkEntries() passes to its callback.
+            */
+            struct Entry
+            {
+                private:
+                    // set if the backend had a std::filesystem::path at hand
+                    const std::filesystem::path* m_path = nullptr;
+
+                    // otherwise, the bytes of the path, and the path once somebody asked for it
+                    std::string_view m_bytes;
+                    mutable std::optional<std::filesystem::path> m_built;
+
+                public:
+                    // the directory path() was found in (exactly as it was passed to the walker)
+                    const std::filesystem::path& dir;
+
+                    // the start directories are depth 0, their contents depth 1, and so on
+                    size_t depth;
+
+                    /*
+                    * index of the thread that found the entry, from 0 to threadCount()-1.
+                    * lets callbacks keep per-thread state (like counters) without any locking.
+                    */
+                    size_t worker;
+
+                    // what the entry points to - i.e., symlinks are followed
+                    bool isdir = false;
+                    bool isfile = false;
+
+                    // whether the entry itself is a symlink. only reliably set for directories
+                    bool islink = false;
+
+                    // whether $stat is valid. only ever true if Config::want_stat is set
+                    bool hasstat = false;
+                    StatInfo stat;
+
+                    Entry(const std::filesystem::path& p, const std::filesystem::path& d, size_t dp, size_t w):
+                        m_path(&p), dir(d), depth(dp), worker(w)
+                    {
+                    }
+
+                    Entry(std::string_view bytes, const std::filesystem::path& d, size_t dp, size_t w):
+                        m_bytes(bytes), dir(d), depth(dp), worker(w)
+                    {
+                    }
+
+                    /*
+                    * the path of the entry.
+                    * the getdents backend only has the bytes of it, and building a
+                    * std::filesystem::path (which allocates, and splits the path into its
+                    * components) costs more than reading and classifying the entry did - so
+                    * it's only built if somebody asks for it.
+                    */
+                    const std::filesystem::path& path() const
+                    {
+                        if(m_path != nullptr)
+                        {
+                            return *m_path;
+                        }
+                        if(!m_built)
+                        {
+                            m_built.emplace(std::string(m_bytes));
+                        }
+                        return *m_built;
+                    }
+
+                    // whether path() had to build a path (which is then counted in WalkStats::path_bytes)
+                    bool pathBuilt() const
+                    {
+                        return m_built.has_value();
+                    }
+
+                    /*
+                    * the bytes of path(), without building it if possible.
+                    * $tmp is only used if a conversion is necessary (i.e., on windows).
+                    */
+                    std::string_view pathBytes(std::string& tmp) const
+                    {
+                        if(m_path == nullptr)
+                        {
+                            return m_bytes;
+                        }
+                        #if defined(_WIN32)
+                            tmp = m_path->string();
+                            return tmp;
+                        #else
+                            (void)tmp;
+                            return m_path->native();
+                        #endif
+                    }
+            };
+
+            using EntryFunc = std::function<void(const Entry&)>;
+
+            /*
+            * like EntryFunc, but returns whether the walker should descend into
+            * the entry (if it's a directory) - returning false prunes it, exactly like
+            * a prune callback would.
+            */
+            using VisitFunc = std::function<bool(const Entry&)>;
+
+            /*
+            * the most threads a walk ever uses, however many were asked for: each of them
+            * gets a deque, a stats shard and possibly a trace buffer, so a bogus count
+            * (like -1 that went through a size_t) must not turn into that many.
+            */
+            static constexpr size_t MaxThreads = 1024;
+
+        public:
+            /*
+            * turns a backend name ("std", "getdents" or "uring") into a Backend.
+            * returns false if the name isn't known.
+            */
+            static bool BackendFromString(const std::string& name, Backend& dest)
+            {
+                if((name == "std") || (name == "standard"))
+                {
+                    dest = Backend::Standard;
+                    return true;
+                }
+                if(name == "getdents")
+                {
+                    dest = Backend::Getdents;
+                    return true;
+                }
+                if((name == "uring") || (name == "io_uring"))
+                {
+                    dest = Backend::Uring;
+                    return true;
+                }
+                return false;
+            }
+
+            /*
+            * resolves a thread count of 0 ("one per core") to an actual number, and caps
+            * it at MaxThreads.
+            */
+            static size_t ResolveThreads(size_t n)
+            {
+                if(n == 0)
+                {
+                    n = std::max(1u, std::thread::hardware_concurrency());
+                }
+                return std::min(n, MaxThreads);
+            }
+
+            static bool DirectoryIs(const std::filesystem::path& input, const std::filesystem::path& findme)
+            {
+                auto filename = input.filename();
+                return filename == findme;
+            }
+
+            static bool DirectoryIs(const std::filesystem::path& input, const std::vector<std::filesystem::path>& items)
+            {
+                for(const auto& item: items)
+                {
+                    if(DirectoryIs(input, item))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            /*
+            * the name the exception callback gets for $phase (these are the names it
+            * has always been given).
+            */
+            static const char* PhaseName(ErrorPhase phase)
+            {
+                switch(phase)
+                {
+                    case ErrorPhase::Open:
+                        return "opendir";
+                    case ErrorPhase::Read:
+                        return "iterator_next";
+                    case ErrorPhase::Status:
+                        return "item_status";
+                    case ErrorPhase::Prune:
+                        return "is_symlink";
+                    case ErrorPhase::Callback:
+                        return "during_eachfn";
+                }
+                return "?";
+            }
+
+            // the message of $err: what the callback threw, or what the system says about its errno
+            static std::string ErrorMessage(const WalkError& err)
+            {
+                if(err.message != nullptr)
+                {
+                    return err.message;
+                }
+                return std::error_code(err.code, std::system_category()).message();
+            }
+
+        private:
+            /*
+            * reports an error of the walker itself: to the error callback if there is one,
+            * otherwise - as a filesystem_error saying $what, like the walker has always
+            * reported them - to the exception callback, or out of walk() with Config::throw_errors.
+            * without any of those, it is only counted.
+            */
+            void reportError(int code, ErrorPhase phase, const std::filesystem::path& path, const char* what, size_t worker)
+            {
+                #if FIND_STATS
+                    m_errors++;
+                #endif
+                if(m_errorfunc)
+                {
+                    /* the handler is user code, so never call it from two threads at once */
+                    std::lock_guard<std::mutex> lock(m_excmutex);
+                    m_errorfunc(WalkError{code, phase, path, nullptr, worker});
+                }
+                else if(m_exceptionfunc || m_opts.throw_errors)
+                {
+                    std::filesystem::filesystem_error ex(what, path, std::error_code(code, std::system_category()));
+                    if(!m_exceptionfunc)
+                    {
+                        throw ex;
+                    }
+                    std::lock_guard<std::mutex> lock(m_excmutex);
+                    m_exceptionfunc(ex, PhaseName(phase), path);
+                }
+            }
+
+            /*
+            * reports $ex, which a callback threw - so this must only be called from a catch block.
+            * if nobody handles it, it is rethrown.
+            */
+            void forward_exception(std::runtime_error& ex, ErrorPhase phase, const std::filesystem::path& path, size_t worker)
+            {
+                #if FIND_STATS
+                    m_errors++;
+                #endif
+                if(m_errorfunc)
+                {
+                    auto fse = dynamic_cast<const std::filesystem::filesystem_error*>(&ex);
+                    std::lock_guard<std::mutex> lock(m_excmutex);
+                    m_errorfunc(WalkError{((fse != nullptr) ? fse->code().value() : 0), phase, path, ex.what(), worker});
+                }
+                else if(m_exceptionfunc)
+                {
+                    std::lock_guard<std::mutex> lock(m_excmutex);
+                    m_exceptionfunc(ex, PhaseName(phase), path);
+                }
+                else
+                {
+                    throw;
+                }
+            }
+
+            /*
+            * whether $entry itself is a symlink.
+            * failing to find out doesn't affect the outcome in any meaningful way,
+            * so that isn't reported.
+            */
+            static bool maybe_symlink(const std::filesystem::directory_entry& entry)
+            {
+                std::error_code ecode;
+                return std::filesystem::is_symlink(entry.symlink_status(ecode));
+            }
+
+        private:
+            std::vector<std::filesystem::path> m_startdirs;
+            std::vector<PruneIfFunc> m_prunefuncs;
+            std::vector<SkipFunc> m_skipfuncs;
+            std::vector<IgnoreFileFunc> m_ignfilefuncs;
+            NameRules m_prunerules;
+            NameRules m_ignorerules;
+            ExceptionFunc m_exceptionfunc;
+            ErrorFunc m_errorfunc;
+            DirDoneFunc m_dirdonefunc;
+            std::mutex m_excmutex;
+            Config m_opts;
+            DirIndex* m_index = nullptr;
+
+            // devices that went over the mount budget, with the directory that did, and what was put off for them
+            std::mutex m_mountmutex;
+            std::atomic<size_t> m_slowcount{0};
+            std::vector<std::pair<uint64_t, std::filesystem::path>> m_slowmounts;
+            std::vector<Detail::WalkItem> m_deferred;
+
+            // see setTracer()
+            Tracer* m_tracer = nullptr;
+
+            // one per thread of the last walk; see stats()
+            std::vector<Detail::StatsShard> m_statshards;
+            std::atomic<uint64_t> m_errors{0};
+            uint64_t m_walkns = 0;
+
+
+        protected:
+            void setup(const std::vector<std::filesystem::path>& dirs)
+            {
+                m_startdirs = dirs;
+            }
+
+            // where $worker records its spans, if there's a tracer
+            Detail::TraceBuffer* traceBuffer(size_t worker)
+            {
+                return ((m_tracer != nullptr) ? m_tracer->buffer(worker) : nullptr);
+            }
+
+            Detail::StatsShard& statsShard(size_t worker)
+            {
+                #if FIND_STATS
+                    return m_statshards[worker];
+                #else
+                    static Detail::StatsShard none;
+                    (void)worker;
+                    return none;
+                #endif
+            }
+
+            /*
+            * whether any of the skip callbacks wants $ent to not be emitted.
+            * (this used to be inverted, and compensated for by the caller - which meant
+            * that nothing at all was emitted if there were no skip callbacks.)
+            */
+            bool skipItem(const Entry& ent)
+            {
+                for(const auto& fn: m_skipfuncs)
+                {
+                    if(fn(ent.path(), ent.isdir, ent.isfile))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            /*
+            * runs the skip/prune/ignore callbacks on a single entry, and emits it
+            * if need be.
+            * the backends only need to figure out Entry::islink for directories.
+            * returns true if $ent is a directory that should be descended into.
+            */
+            bool visitEntry(const Entry& ent, const IgnoreScope* scope, const VisitFunc& eachfn)
+            {
+                bool isdir;
+                bool isfile;
+                bool ispruned;
+                bool emitme;
+                std::string tmp;
+                Detail::StatsShard& stats = statsShard(ent.worker);
+                Detail::PhaseTimer timer(stats, Detail::StatsShard::Phase::Callbacks);
+                Detail::TraceSpan span(m_tracer, traceBuffer(ent.worker), Detail::TraceBuffer::Kind::Callback);
+                isdir = ent.isdir;
+                isfile = ent.isfile;
+                /*
+                * the rule sets come first: they're cheap, and work on the bytes of the path,
+                * so an entry they reject never needs a std::filesystem::path.
+                */
+                if(isdir && (!ent.islink) && (!m_prunerules.empty()) && m_prunerules.match(ent.pathBytes(tmp)))
+                {
+                    stats.count(&WalkStats::pruned);
+                    return false;
+                }
+                if(isfile && (!m_ignorerules.empty()) && m_ignorerules.match(ent.pathBytes(tmp)))
+                {
+                    return false;
+                }
+                if(!m_opts.ignore_files.empty())
+                {
+                    // like git itself, never look into the repository
+                    if(isdir && (Detail::baseName(ent.pathBytes(tmp)) == ".git"))
+                    {
+                        stats.count(&WalkStats::pruned);
+                        return false;
+                    }
+                    if((scope != nullptr) && scope->ignored(ent.pathBytes(tmp), (isdir && !ent.islink)))
+                    {
+                        if(isdir && !ent.islink)
+                        {
+                            stats.count(&WalkStats::pruned);
+                        }
+                        return false;
+                    }
+                }
+                emitme = true;
+                ispruned = false;
+                emitme = !skipItem(ent);
+                if(isdir)
+                {
+                    try
+                    {
+                        if(ent.islink /* && do not follow links? */)
+                        {
+                            //iter.disable_recursion_pending();
+                            ispruned = true;
+                        }
+                        else
+                        {
+                            ispruned = false;
+                            for(const auto& prunefn: m_prunefuncs)
+                            {
+                                if(prunefn != nullptr)
+                                {
+                                    if(prunefn(ent.path()))
+                                    {
+                                        //iter.pop();
+                                        //iter.no_push();
+                                        //iter.disable_recursion_pending();
+                                        ispruned = true;
+                                        emitme = false;
+                                    }
+                                }
+                            }
+                        }
+                    }
+                    catch(std::runtime_error& ex)
+                    {
+                        forward_exception(ex, ErrorPhase::Prune, ent.path(), ent.worker);
+                    }
+
+                }
+                else if(isfile)
+                {
+                    ispruned = false;
+                    for(const auto& filefn: m_ignfilefuncs)
+                    {
+                        if(filefn(ent.path()))
+                        {
+                            //std::cout << "-- filefn returned false for " << entry << std::endl; 
+                            ispruned = true;
+                            emitme = false;
+                        }
+                    }
+                }
+                if(emitme)
+                {
+                    try
+                    {
+                        /*
+                        * calling .path() is likely where an exception may occur.
+                        * specifically, for windows, paths containing a ':' will throw exceptions ...
+                        * i.e., "foo::bar.txt" will throw, and the "recovered" filename
+                        * would be something like "foo-:-:bar.txt" (at least on windows).
+                        * this is sadly a limitation of std::filesystem, and i don't think
+                        * there's a realistic way of getting around this, save for
+                        * manually parsing ...
+                        */
+                        if(!eachfn(ent))
+                        {
+                            ispruned = true;
+                        }
+                    }
+                    catch(std::runtime_error& ex)
+                    {
+                        #if defined(_WIN32)
+                            std::string fname;
+                            try
+                            {
+                                /*
+                                * there is a possibility that this exception happens
+                                * *in* eachfn ...
+                                * for some reason, string() will throw, but wstring() does not.
+                                * this is for the msvcrt impl. not sure why? this hack
+                                * extracts the path somewhat-ish correctly-ish.
+                                * atm, this assumes that wstring() returns UTF-16, which
+                                * only holds on windows - elsewhere, it cut paths short.
+                                */
+                                auto ws = ent.path().wstring();
+                                fname.append(static_cast<const char*>((const void*)ws.data()), ws.size()*2);
+                                fname.erase(std::remove(fname.begin(), fname.end(), char(0)), fname.end());
+                            }
+                            catch(...)
+                            {
+                                fname = "[invalid filename?]";
+                            }
+                            forward_exception(ex, ErrorPhase::Callback, fname, ent.worker);
+                        #else
+                            forward_exception(ex, ErrorPhase::Callback, ent.path(), ent.worker);
+                        #endif
+                    }
+                }
+                // symlinks are never descended into, but nobody pruned them
+                if(isdir && ispruned && !ent.islink)
+                {
+                    stats.count(&WalkStats::pruned);
+                }
+                return (isdir && (!ispruned));
+            }
+
+            bool budgeted(const Detail::WalkItem& item) const
+            {
+                return ((m_opts.mount_budget.count() > 0) && (!item.deferred));
+            }
+
+            // only with m_mountmutex held
+            bool knownSlowMount(uint64_t device) const
+            {
+                for(const auto& slow: m_slowmounts)
+                {
+                    if(slow.first == device)
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            bool isSlowMount(uint64_t device)
+            {
+                if(m_slowcount.load() == 0)
+                {
+                    return false;
+                }
+                std::lock_guard<std::mutex> lock(m_mountmutex);
+                return knownSlowMount(device);
+            }
+
+            void checkBudget(const std::filesystem::path& dir, uint64_t device, std::chrono::steady_clock::duration took)
+            {
+                if(took <= m_opts.mount_budget)
+                {
+                    return;
+                }
+                // checked and added in one go, or two workers could both add the same device
+                std::lock_guard<std::mutex> lock(m_mountmutex);
+                if(!knownSlowMount(device))
+                {
+                    m_slowmounts.emplace_back(device, dir);
+                    m_slowcount++;
+                }
+            }
+
+            void directoryDone(const Detail::WalkItem& item, size_t worker)
+            {
+                if(m_dirdonefunc)
+                {
+                    Detail::PhaseTimer timer(statsShard(worker), Detail::StatsShard::Phase::Callbacks);
+                    m_dirdonefunc(item.dir, item.depth, worker);
+                }
+            }
+
+            /*
+            * reads a single directory, and calls $subdirfn with a WalkItem for every directory
+            * that should be descended into.
+            * $item.scope is the ignore scope of the directory's parent; the ignore files in
+            * the directory itself are read here, before any of its entries are looked at.
+            * this is also where mount boundaries and the mount budget are checked - which
+            * has to happen before the directory is opened, since that can already be slow.
+            * max_depth is checked here as well, so a directory that's too deep is never even queued.
+            * this is the part that the sequential walker and the parallel walker have in common.
+            */
+            template<typename SubdirFuncT>
+            void scanDirectory(const Detail::WalkItem& item, size_t worker, const VisitFunc& eachfn, SubdirFuncT&& subdirfn)
+            {
+                uint64_t device;
+                IgnoreScope::Ptr here;
+                std::chrono::steady_clock::time_point started;
+                Detail::PhaseTimer timer(statsShard(worker), Detail::StatsShard::Phase::Scan);
+                #if defined(_WIN32)
+                    Detail::TraceDirectory dirspan(m_tracer, traceBuffer(worker), ((m_tracer != nullptr) ? item.dir.string() : std::string()));
+                #else
+                    Detail::TraceDirectory dirspan(m_tracer, traceBuffer(worker), item.dir.native());
+                #endif
+                const auto& dir = item.dir;
+                device = item.device;
+                if(m_opts.one_filesystem || budgeted(item))
+                {
+                    statsShard(worker).count(&WalkStats::stat_calls);
+                    if(!Detail::pathDevice(dir, device))
+                    {
+                        device = item.device;
+                    }
+                    if(m_opts.one_filesystem && (item.device != 0) && (device != item.device))
+                    {
+                        directoryDone(item, worker);
+                        return;
+                    }
+                    if(budgeted(item) && isSlowMount(device))
+                    {
+                        if(m_opts.defer_slow_mounts)
+                        {
+                            // it's done once it has actually been read
+                            std::lock_guard<std::mutex> lock(m_mountmutex);
+                            m_deferred.push_back(Detail::WalkItem{item.dir, item.depth, item.scope, item.device, true});
+                            return;
+                        }
+                        directoryDone(item, worker);
+                        return;
+                    }
+                }
+                here = item.scope;
+                if(!m_opts.ignore_files.empty())
+                {
+                    here = IgnoreScope::enter(dir.string(), item.scope, m_opts.ignore_files);
+                }
+                started = std::chrono::steady_clock::now();
+                auto withitem = [&](const std::filesystem::path& subdir)
+                {
+                    // the entries of $subdir would be deeper than max_depth
+                    if((m_opts.max_depth != 0) && ((item.depth + 1) >= m_opts.max_depth))
+                    {
+                        return;
+                    }
+                    subdirfn(Detail::WalkItem{subdir, item.depth + 1, here, device, item.deferred});
+                };
+                try
+                {
+                    if(m_index != nullptr)
+                    {
+                        scanIndexed(dir, item.depth, worker, here.get(), eachfn, withitem);
+                    }
+                    else
+                    {
+                        scanBackend(dir, item.depth, worker, here.get(), eachfn, withitem, nullptr);
+                    }
+                }
+                catch(...)
+                {
+                    // the walk is over (see reportError()), but this directory is done all the same
+                    directoryDone(item, worker);
+                    throw;
+                }
+                if(budgeted(item))
+                {
+                    checkBudget(dir, device, (std::chrono::steady_clock::now() - started));
+                }
+                directoryDone(item, worker);
+            }
+
+            /*
+            * reads $dir with the configured backend.
+            * if $listing isn't null, every entry is also recorded in it (before any callbacks
+            * get to filter it).
+            */
+            template<typename SubdirFuncT>
+            void scanBackend(const std::filesystem::path& dir, size_t depth, size_t worker, const IgnoreScope* scope, const VisitFunc& eachfn, SubdirFuncT&& subdirfn, DirIndex::IndexedDir* listing)
+            {
+                #if defined(__linux__)
+                    if((m_opts.backend == Backend::Getdents) || (m_opts.backend == Backend::Uring))
+                    {
+                        scanGetdents(dir, depth, worker, scope, eachfn, subdirfn, listing);
+                        return;
+                    }
+                #endif
+                scanStandard(dir, depth, worker, scope, eachfn, subdirfn, listing);
+            }
+
+            /*
+            * scans $dir with the help of the index: if it hasn't changed since the
+            * index was written, its entries are replayed from there, which costs one
+            * stat() instead of reading the directory (and, with want_stat, stat'ing
+            * everything in it). otherwise it's read as usual, and the index updated.
+            * subdirectories are checked on their own, once the walker gets to them.
+            */
+            template<typename SubdirFuncT>
+            void scanIndexed(const std::filesystem::path& dir, size_t depth, size_t worker, const IgnoreScope* scope, const VisitFunc& eachfn, SubdirFuncT&& subdirfn)
+            {
+                int64_t mtime;
+                size_t dirlen;
+                std::string key;
+                std::string fullpath;
+                std::vector<std::filesystem::path> subdirs;
+                Detail::StatsShard& stats = statsShard(worker);
+                key = dir.string();
+                // the mtime must be taken before reading, so that changes made while reading show up next time
+                stats.count(&WalkStats::stat_calls);
+                if(!Detail::pathMtime(dir, mtime))
+                {
+                    scanBackend(dir, depth, worker, scope, eachfn, subdirfn, nullptr);
+                    return;
+                }
+                auto cached = m_index->find(key, mtime, m_opts.want_stat);
+                if(cached == nullptr)
+                {
+                    auto fresh = std::make_shared<DirIndex::IndexedDir>();
+                    fresh->mtime = mtime;
+                    fresh->hasstat = m_opts.want_stat;
+                    scanBackend(dir, depth, worker, scope, eachfn, subdirfn, fresh.get());
+                    if(fresh->complete)
+                    {
+                        m_index->store(key, std::move(fresh), false);
+                    }
+                    return;
+                }
+                fullpath = key;
+                if(!fullpath.empty() && (fullpath.back() != '/') && (fullpath.back() != char(std::filesystem::path::preferred_separator)))
+                {
+                    fullpath.push_back(char(std::filesystem::path::preferred_separator));
+                }
+                dirlen = fullpath.size();
+                stats.count(&WalkStats::dirs_reused);
+                for(const auto& ie: cached->entries)
+                {
+                    fullpath.resize(dirlen);
+                    fullpath.append(cached->nameOf(ie));
+                    stats.count(&WalkStats::entries);
+                    Entry item(std::string_view(fullpath), dir, depth + 1, worker);
+                    item.isdir = ((ie.flags & DirIndex::FlagIsDir) != 0);
+                    item.isfile = ((ie.flags & DirIndex::FlagIsFile) != 0);
+                    item.islink = ((ie.flags & DirIndex::FlagIsLink) != 0);
+                    item.hasstat = (m_opts.want_stat && ((ie.flags & DirIndex::FlagHasStat) != 0));
+                    item.stat = ie.stat;
+                    if(visitEntry(item, scope, eachfn))
+                    {
+                        subdirs.push_back(item.path());
+                    }
+                    if(item.pathBuilt())
+                    {
+                        stats.count(&WalkStats::path_bytes, fullpath.size());
+                    }
+                }
+                m_index->store(key, std::move(cached), true);
+                for(const auto& subdir: subdirs)
+                {
+                    subdirfn(subdir);
+                }
+            }
+
+            /*
+            * the std::filesystem backend: portable, but costs a stat() (and for directories,
+            * another lstat()) per entry, plus a heap-allocated path for each of them.
+            * only the error_code overloads are used, so a directory that can't be read, or
+            * an entry that can't be stat'd, is reported without anything being thrown.
+            */
+            template<typename SubdirFuncT>
+            void scanStandard(const std::filesystem::path& dir, size_t depth, size_t worker, const IgnoreScope* scope, const VisitFunc& eachfn, SubdirFuncT&& subdirfn, DirIndex::IndexedDir* listing)
+            {
+                std::error_code ecode;
+                std::filesystem::directory_iterator end;
+                Detail::StatsShard& stats = statsShard(worker);
+                Detail::PhaseTimer opentimer(stats, Detail::StatsShard::Phase::Open);
+                Detail::TraceSpan openspan(m_tracer, traceBuffer(worker), Detail::TraceBuffer::Kind::Open);
+                /*
+                * this check is necessary because in certain circumstances, passing
+                * a non-existant path to directory_iterator will not fail, but
+                * simply iterate nothing at all.
+                * mind you, this is a hack meant to fix something that i really shouldn't
+                * have to fix...
+                */
+                stats.count(&WalkStats::stat_calls);
+                if(!std::filesystem::is_directory(dir, ecode))
+                {
+                    if(listing != nullptr)
+                    {
+                        listing->complete = false;
+                    }
+                    reportError((ecode ? ecode.value() : ENOTDIR), ErrorPhase::Open, dir, "not a directory", worker);
+                    return;
+                }
+                std::filesystem::directory_iterator iter(dir, ecode);
+                opentimer.stop();
+                openspan.stop();
+                if(ecode)
+                {
+                    if(listing != nullptr)
+                    {
+                        listing->complete = false;
+                    }
+                    reportError(ecode.value(), ErrorPhase::Open, dir, "directory iterator cannot open directory", worker);
+                    return;
+                }
+                stats.count(&WalkStats::dirs_opened);
+                while(iter != end)
+                {
+                    const auto& entry = *iter;
+                    // every entry comes with a path of its own
+                    stats.count(&WalkStats::entries);
+                    stats.count(&WalkStats::path_bytes, entry.path().native().size());
+                    stats.count(&WalkStats::stat_calls);
+                    /*
+                    * a dangling symlink is not an error (it's just not_found); only a status
+                    * that couldn't be determined at all is.
+                    */
+                    auto status = entry.status(ecode);
+                    if(std::filesystem::status_known(status))
+                    {
+                        Entry ent(entry.path(), dir, depth + 1, worker);
+                        ent.isdir = std::filesystem::is_directory(status);
+                        ent.isfile = std::filesystem::is_regular_file(status);
+                        if(ent.isdir)
+                        {
+                            stats.count(&WalkStats::stat_calls);
+                        }
+                        ent.islink = (ent.isdir && maybe_symlink(entry));
+                        if(m_opts.want_stat && (ent.isdir || ent.isfile))
+                        {
+                            stats.count(&WalkStats::stat_calls);
+                            ent.hasstat = Detail::statPath(entry.path(), ent.stat);
+                        }
+                        if(listing != nullptr)
+                        {
+                            listing->add(entry.path().filename().string(), ent.isdir, ent.isfile, ent.islink, ent.hasstat, ent.stat);
+                        }
+                        if(visitEntry(ent, scope, eachfn))
+                        {
+                            stats.count(&WalkStats::path_bytes, entry.path().native().size());
+                            subdirfn(entry.path());
+                        }
+                    }
+                    else
+                    {
+                        if(listing != nullptr)
+                        {
+                            listing->complete = false;
+                        }
+                        reportError(ecode.value(), ErrorPhase::Status, entry.path(), "cannot get file status", worker);
+                    }
+                    iter.increment(ecode);
+                    if(ecode)
+                    {
+                        if(listing != nullptr)
+                        {
+                            listing->complete = false;
+                        }
+                        reportError(ecode.value(), ErrorPhase::Read, dir, "directory iterator cannot advance", worker);
+                        return;
+                    }
+                }
+            }
+
+        #if defined(__linux__)
+            /*
+            * the getdents64 backend: reads the directory in large batches into a reusable
+            * (per-thread) buffer, and classifies entries by their d_type, so regular files
+            * and directories cost no syscall at all.
+            * only symlinks (to find out what they point to), and entries whose d_type is
+            * DT_UNKNOWN (some filesystems, like older XFS, don't fill it in) are fstatat()'d.
+            * subdirectories are handed to $subdirfn once the directory has been read completely,
+            * and the file descriptor has been closed.
+            * with Backend::Uring and want_stat, each batch is statx()'d through the thread's ring
+            * before any of its entries are visited; entries with DT_UNKNOWN (which need to be
+            * lstat'd first), and whatever the ring couldn't do, go through statDirent() instead.
+            */
+            template<typename SubdirFuncT>
+            void scanGetdents(const std::filesystem::path& dir, size_t depth, size_t worker, const IgnoreScope* scope, const VisitFunc& eachfn, SubdirFuncT&& subdirfn, DirIndex::IndexedDir* listing)
+            {
+                long nread;
+                long pos;
+                size_t dirlen;
+                std::string fullpath;
+                std::vector<std::filesystem::path> subdirs;
+                Detail::StatsShard& stats = statsShard(worker);
+                Detail::PhaseTimer opentimer(stats, Detail::StatsShard::Phase::Open);
+                Detail::TraceSpan openspan(m_tracer, traceBuffer(worker), Detail::TraceBuffer::Kind::Open);
+                Detail::DirHandle dh(dir);
+                std::vector<char>& buf = Detail::getdentsBuffer();
+                #if defined(FIND_HAVE_URING)
+                    size_t ri;
+                    bool batched;
+                    Detail::StatxRing* ring;
+                    std::vector<Detail::StatxRing::Request>& reqs = Detail::statxRequests();
+                    ring = nullptr;
+                    if((m_opts.backend == Backend::Uring) && m_opts.want_stat)
+                    {
+                        ring = Detail::statxRing();
+                    }
+                #endif
+                if(!dh.good())
                 {
-                    if(DirectoryIs(input, item))
+                    if(listing != nullptr)
                     {
-                        return true;
+                        listing->complete = false;
                     }
+                    reportError(dh.error(), ErrorPhase::Open, dir, "directory iterator cannot open directory", worker);
+                    return;
                 }
-                return false;
-            }
-
-        private:
-            template<typename ExcType>
-            void forward_exception(ExcType& ex, const std::string& origin, const std::filesystem::path& path)
-            {
-                if(m_exceptionfunc)
+                opentimer.stop();
+                openspan.stop();
+                stats.count(&WalkStats::dirs_opened);
+                fullpath = dir.string();
+                if(!fullpath.empty() && (fullpath.back() != '/'))
                 {
-                    m_exceptionfunc(ex, origin, path);
+                    fullpath.push_back('/');
                 }
-                else
+                dirlen = fullpath.size();
+                while(true)
                 {
-                    throw ex;
+                    {
+                        Detail::TraceSpan readspan(m_tracer, traceBuffer(worker), Detail::TraceBuffer::Kind::Read);
+                        nread = syscall(SYS_getdents64, dh.fd(), buf.data(), buf.size());
+                        readspan.setCount((nread > 0) ? uint64_t(nread) : 0);
+                    }
+                    if(nread == 0)
+                    {
+                        break;
+                    }
+                    if(nread < 0)
+                    {
+                        if(listing != nullptr)
+                        {
+                            listing->complete = false;
+                        }
+                        reportError(errno, ErrorPhase::Read, dir, "getdents64 failed", worker);
+                        break;
+                    }
+                    #if defined(FIND_HAVE_URING)
+                        ri = 0;
+                        batched = (ring != nullptr);
+                        if(batched)
+                        {
+                            reqs.clear();
+                            for(pos=0; pos<nread;)
+                            {
+                                auto ent = reinterpret_cast<const Detail::LinuxDirent64*>(buf.data() + pos);
+                                pos += ent->d_reclen;
+                                if(!Detail::isDotOrDotDot(ent->d_name) && (ent->d_type != DT_UNKNOWN))
+                                {
+                                    reqs.emplace_back();
+                                    reqs.back().name = ent->d_name;
+                                }
+                            }
+                            stats.count(&WalkStats::statx_batched, reqs.size());
+                            Detail::TraceSpan batchspan(m_tracer, traceBuffer(worker), Detail::TraceBuffer::Kind::StatBatch);
+                            batchspan.setCount(reqs.size());
+                            if(!ring->run(dh.fd(), reqs))
+                            {
+                                // whatever is still pending is stat'd one by one, and so is everything after it
+                                ring = nullptr;
+                            }
+                        }
+                    #endif
+                    for(pos=0; pos<nread;)
+                    {
+                        auto ent = reinterpret_cast<const Detail::LinuxDirent64*>(buf.data() + pos);
+                        pos += ent->d_reclen;
+                        if(Detail::isDotOrDotDot(ent->d_name))
+                        {
+                            continue;
+                        }
+                        fullpath.resize(dirlen);
+                        fullpath.append(ent->d_name);
+                        stats.count(&WalkStats::entries);
+                        Entry item(std::string_view(fullpath), dir, depth + 1, worker);
+                        #if defined(FIND_HAVE_URING)
+                            if(batched && (ent->d_type != DT_UNKNOWN) && (reqs[ri++].result != Detail::StatxRing::Pending))
+                            {
+                                item.hasstat = Detail::statxDirent(ent, reqs[ri - 1], item.isdir, item.isfile, item.islink, item.stat);
+                            }
+                            else
+                        #endif
+                        if(m_opts.want_stat)
+                        {
+                            item.hasstat = Detail::statDirent(dh.fd(), ent, item.isdir, item.isfile, item.islink, item.stat, stats);
+                        }
+                        else
+                        {
+                            Detail::classifyDirent(dh.fd(), ent, item.isdir, item.isfile, item.islink, stats);
+                        }
+                        if(listing != nullptr)
+                        {
+                            listing->add(ent->d_name, item.isdir, item.isfile, item.islink, item.hasstat, item.stat);
+                        }
+                        if(visitEntry(item, scope, eachfn))
+                        {
+                            // straight from the bytes: item.path() would build a path only to copy it
+                            subdirs.emplace_back(fullpath);
+                            stats.count(&WalkStats::path_bytes, fullpath.size());
+                        }
+                        if(item.pathBuilt())
+                        {
+                            stats.count(&WalkStats::path_bytes, fullpath.size());
+                        }
+                    }
                 }
-            }
-
-            /*
-            * this function is necessary, because for some very strange reason,
-            * is_symlink() may actually throw an exception ...
-            * this only applies when iterating directories, though.
-            */
-            template<typename Type>
-            bool maybe_symlink(const Type& path)
-            {
-                try
                 {
-                    return std::filesystem::is_symlink(path);
+                    Detail::TraceSpan closespan(m_tracer, traceBuffer(worker), Detail::TraceBuffer::Kind::Close);
+                    dh.close();
                 }
-                /*
-                * no point in handling this exception:
-                * it doesn't affect the outcome in any meaningful way.
-                */
-                catch(...)
+                for(const auto& subdir: subdirs)
                 {
+                    subdirfn(subdir);
                 }
-                return false;
-            }
-
-        private:
-            std::vector<std::filesystem::path> m_startdirs;
-            std::vector<PruneIfFunc> m_prunefuncs;
-            std::vector<SkipFunc> m_skipfuncs;
-            std::vector<IgnoreFileFunc> m_ignfilefuncs;
-            ExceptionFunc m_exceptionfunc;
-            Config m_opts;
-            size_t m_depthlevel = 0;
-
-
-        protected:
-            void setup(const std::vector<std::filesystem::path>& dirs)
-            {
-                m_startdirs = dirs;
             }
+        #endif
 
-            bool skipItem(const std::filesystem::path& path, bool isdir, bool isfile)
+            /*
+            * the single-threaded walker: depth-first, off an explicit stack of pending
+            * directories, so the depth of a tree is only limited by memory, not by the
+            * size of the call stack.
+            * a directory is read completely before any of its subdirectories (so only one
+            * is open at a time); those are then pushed in reverse, so that they're
+            * walked in the order they were found.
+            */
+            void doWalk(const Detail::WalkItem& start, const VisitFunc& eachfn)
             {
-                for(const auto& fn: m_skipfuncs)
+                size_t first;
+                Detail::WalkItem item;
+                std::vector<Detail::WalkItem> stack;
+                stack.push_back(start);
+                while(!stack.empty())
                 {
-                    if(!fn(path, isdir, isfile))
+                    item = std::move(stack.back());
+                    stack.pop_back();
+                    first = stack.size();
+                    scanDirectory(item, 0, eachfn, [&](Detail::WalkItem&& sub)
                     {
-                        return true;
-                    }
+                        stack.push_back(std::move(sub));
+                    });
+                    std::reverse(stack.begin() + first, stack.end());
                 }
-                return false;
             }
 
-            void doWalk(const std::filesystem::path& dir, const EachFunc& eachfn)
+            /*
+            * the parallel walker.
+            * every thread owns a deque of pending directories; subdirectories found
+            * by a thread go to its own deque, and a thread that runs dry steals
+            * from the others. the walk is done once no directory is pending anymore,
+            * which is tracked by $pending: a directory is counted from the moment
+            * it is queued until it has been read completely (including queueing its
+            * subdirectories), so the count can't drop to zero while there's still work left.
+            */
+            void doParallelWalk(const std::vector<Detail::WalkItem>& items, const VisitFunc& eachfn, size_t nthreads)
             {
-                bool isdir;
-                bool isfile;
-                bool ispruned;
-                bool emitme;
-                std::error_code ecode;
-                std::vector<std::filesystem::path> dircache;
-                std::filesystem::directory_iterator end;
-                isfile = false;
-                isdir = false;
-                emitme = true;
-                ispruned = false;
-                //#if (!defined(__CYGWIN__)) && (!defined(__CYGWIN32__))
+                size_t i;
+                std::atomic<size_t> pending(0);
+                std::atomic<bool> failed(false);
+                std::exception_ptr failure;
+                std::mutex failmutex;
+                std::vector<std::thread> threads;
+                std::vector<Detail::WorkDeque> deques(nthreads);
                 /*
-                * this check is necessary because in certain circumstances, passing
-                * a non-existant path to recursive_directory_iterator, even without error_code,
-                * will not throw an exception ...
-                * the solution: check if $iter equals $end, and if it does, also
-                * check if $dir exists at all.
-                * if those are true, manually throw an exception!
-                * as std::filesystem* isn't available for cygwin (yet?), this
-                * won't apply for the boost::filesystem wrapper, and in fact, won't compile
-                * (due to constructor diffs - boost::system::error_code vs std::error_code).
-                *
-                * mind you, this is a hack meant to fix something that i really shouldn't
-                * have to fix...
+                * idle workers spin for a bit, then park on $idlecv until something is pushed
+                * (counted by $pushes), or the walk is over. $sleepers is raised under
+                * $idlemutex before a worker checks whether it may sleep, so a push either
+                * sees it and wakes that worker, or happened early enough to be seen by it.
                 */
-                if(!std::filesystem::is_directory(dir, ecode))
+                static constexpr size_t IdleSpins = 64;
+                std::atomic<size_t> pushes(0);
+                std::atomic<size_t> sleepers(0);
+                std::mutex idlemutex;
+                std::condition_variable idlecv;
+                for(i=0; i<items.size(); i++)
                 {
-                    auto ex = std::filesystem::filesystem_error("not a directory", dir, ecode);
-                    forward_exception(ex, "init", dir);
+                    pending++;
+                    deques[i % nthreads].push(Detail::WalkItem(items[i]));
                 }
-                //#endif
-                std::filesystem::directory_iterator iter(dir);
-                while(iter != end)
+                auto steal = [&](size_t self, Detail::WalkItem& dest)
                 {
-                    auto entry = *iter;
-                    try
+                    size_t j;
+                    for(j=1; j<nthreads; j++)
                     {
-                        auto status = entry.status();
-                        emitme = true;
-                        isdir = std::filesystem::is_directory(status);
-                        isfile = std::filesystem::is_regular_file(status);
-                        emitme = skipItem(entry, isdir, isfile);
-                        if(isdir)
+                        if(deques[(self + j) % nthreads].stealFront(dest))
                         {
-                            try
+                            return true;
+                        }
+                    }
+                    return false;
+                };
+                // wakes every parked worker, once the walk is over
+                auto wakeAll = [&]
+                {
+                    std::lock_guard<std::mutex> lock(idlemutex);
+                    idlecv.notify_all();
+                };
+                auto worker = [&](size_t self)
+                {
+                    size_t spins;
+                    size_t seen;
+                    Detail::WalkItem item;
+                    // running while this thread has nothing to do
+                    std::optional<Detail::PhaseTimer> idle;
+                    spins = 0;
+                    while((pending.load() > 0) && (!failed.load()))
+                    {
+                        seen = pushes.load();
+                        if(!(deques[self].popBack(item) || steal(self, item)))
+                        {
+                            if(!idle)
                             {
-                                if(maybe_symlink(entry) /* && do not follow links? */)
-                                {
-                                    //iter.disable_recursion_pending();
-                                    ispruned = true;
-                                }
-                                else
-                                {
-                                    ispruned = false;
-                                    for(const auto& prunefn: m_prunefuncs)
-                                    {
-                                        if(prunefn != nullptr)
-                                        {
-                                            if(prunefn(entry))
-                                            {
-                                                //iter.pop();
-                                                //iter.no_push();
-                                                //iter.disable_recursion_pending();
-                                                ispruned = true;
-                                                emitme = false;
-                                            }
-                                        }
-                                    }
-                                }
+                                idle.emplace(statsShard(self), Detail::StatsShard::Phase::Idle);
                             }
-                            catch(std::runtime_error& ex)
+                            if(spins < IdleSpins)
                             {
-                                forward_exception(ex, "is_symlink", entry);
+                                spins++;
+                                std::this_thread::yield();
+                                continue;
                             }
-
+                            std::unique_lock<std::mutex> lock(idlemutex);
+                            sleepers++;
+                            idlecv.wait(lock, [&]
+                            {
+                                return ((pushes.load() != seen) || (pending.load() == 0) || failed.load());
+                            });
+                            sleepers--;
+                            continue;
                         }
-                        else if(isfile)
+                        spins = 0;
+                        idle.reset();
+                        try
                         {
-                            ispruned = false;
-                            for(const auto& filefn: m_ignfilefuncs)
+                            scanDirectory(item, self, eachfn, [&](Detail::WalkItem&& sub)
                             {
-                                if(filefn(entry))
+                                pending++;
+                                deques[self].push(std::move(sub));
+                                pushes++;
+                                if(sleepers.load() > 0)
                                 {
-                                    //std::cout << "-- filefn returned false for " << entry << std::endl; 
-                                    ispruned = true;
-                                    emitme = false;
+                                    std::lock_guard<std::mutex> lock(idlemutex);
+                                    idlecv.notify_one();
                                 }
-                            }
+                            });
                         }
-                        if(emitme)
+                        // only what nobody handled (see reportError()) gets here, and ends the walk
+                        catch(...)
                         {
-                            try
-                            {
-                                /*
-                                * calling .path() is likely where an exception may occur.
-                                * specifically, for windows, paths containing a ':' will throw exceptions ...
-                                * i.e., "foo::bar.txt" will throw, and the "recovered" filename
-                                * would be something like "foo-:-:bar.txt" (at least on windows).
-                                * this is sadly a limitation of std::filesystem, and i don't think
-                                * there's a realistic way of getting around this, save for
-                                * manually parsing ...
-                                */
-                                eachfn(entry.path());
-                            }
-                            catch(std::runtime_error& ex)
                             {
-                                std::string fname;
-                                try
-                                {
-                                    /*
-                                    * there is a possibility that this exception happens
-                                    * *in* eachfn ...
-                                    * for some reason, string() will throw, but wstring() does not.
-                                    * this is for the msvcrt impl. not sure why? this hack
-                                    * extracts the path somewhat-ish correctly-ish.
-                                    * atm, this assumes that wstring() returns UTF-16, so
-                                    * this may very well behave differently, and even oddly
-                                    * on other platforms.
-                                    */
-                                    auto ws = entry.path().wstring();
-                                    fname.append(static_cast<const char*>((const void*)ws.data()), ws.size()*2);
-                                    fname.erase(std::remove(fname.begin(), fname.end(), char(0)), fname.end());
-                                }
-                                catch(...)
+                                std::lock_guard<std::mutex> lock(failmutex);
+                                if(!failure)
                                 {
-                                    fname = "[invalid filename?]";
+                                    failure = std::current_exception();
                                 }
-                                forward_exception(ex, "during_eachfn", fname);
+                                failed = true;
                             }
+                            wakeAll();
                         }
-                        if(isdir && (!ispruned))
+                        if(pending.fetch_sub(1) == 1)
                         {
-                            if(m_opts.use_dircache)
-                            {
-                                dircache.push_back(entry);
-                            }
-                            else
-                            {
-                                if((m_opts.max_depth == 0) || (m_depthlevel != m_opts.max_depth))
-                                {
-                                    m_depthlevel++;
-                                    doWalk(entry, eachfn);
-                                }
-                            }
+                            wakeAll();
                         }
                     }
-                    catch(std::runtime_error& ex)
-                    {
-                        forward_exception(ex, "item_status", dir);
-                    }
-                    try
-                    {
-                        iter++;
-                    }
-                    catch(std::runtime_error& ex)
-                    {
-                        forward_exception(ex, "iterator_next", dir);
-                        return;
-                    }
+                };
+                for(i=1; i<nthreads; i++)
+                {
+                    threads.emplace_back(worker, i);
                 }
-                if(m_opts.use_dircache)
+                worker(0);
+                for(auto& th: threads)
                 {
-                    for(auto& p: dircache)
-                    {
-                        doWalk(p, eachfn);
-                    }
+                    th.join();
+                }
+                if(failure)
+                {
+                    std::rethrow_exception(failure);
                 }
             }
 
@@ -393,6 +2317,139 @@ namespace Find
                 return m_opts.max_depth;
             }
 
+            /*
+            * set the number of threads used by walk(), up to MaxThreads.
+            * see Config::threads.
+            */
+            void setThreads(size_t n)
+            {
+                m_opts.threads = std::min(n, MaxThreads);
+            }
+
+            size_t getThreads() const
+            {
+                return m_opts.threads;
+            }
+
+            // the number of threads walk() will actually use, i.e., with 0 resolved to the number of cores
+            size_t threadCount() const
+            {
+                return ResolveThreads(m_opts.threads);
+            }
+
+            void setBackend(Backend be)
+            {
+                m_opts.backend = be;
+            }
+
+            Backend getBackend() const
+            {
+                return m_opts.backend;
+            }
+
+            /*
+            * whether walkEntries() should provide stat data.
+            * see Config::want_stat.
+            */
+            void setWantStat(bool b)
+            {
+                m_opts.want_stat = b;
+            }
+
+            /*
+            * whether stats() should include time per phase.
+            * see Config::time_stats.
+            */
+            void setTimeStats(bool b)
+            {
+                m_opts.time_stats = b;
+            }
+
+            /*
+            * record what every thread does, and when, in $tr - see Tracer.
+            * the caller owns it; it can be shared by Finders that don't walk at the same time.
+            */
+            void setTracer(Tracer* tr)
+            {
+                m_tracer = tr;
+            }
+
+            /*
+            * what the last walk did; see WalkStats.
+            * all zeroes if built with FIND_STATS=0.
+            */
+            WalkStats stats() const
+            {
+                WalkStats rt;
+                #if FIND_STATS
+                    for(const auto& sh: m_statshards)
+                    {
+                        sh.mergeInto(rt);
+                    }
+                    rt.threads = m_statshards.size();
+                    rt.errors = m_errors.load();
+                    rt.ns_walk = m_walkns;
+                #endif
+                return rt;
+            }
+
+            /*
+            * use $idx to skip reading directories that haven't changed since it was
+            * written. see DirIndex. the caller owns the index, and is in charge of
+            * load()ing and save()ing it.
+            */
+            void setIndex(DirIndex* idx)
+            {
+                m_index = idx;
+            }
+
+            /*
+            * honor .gitignore-style files named $names (like {".gitignore", ".ignore"}):
+            * entries they ignore are neither emitted nor descended into, and ".git"
+            * directories are skipped as well.
+            * every directory's ignore files are read once, before its entries are looked at,
+            * and apply to everything below it. ignore files above the start directories
+            * aren't consulted. see GitIgnore and IgnoreScope.
+            */
+            void setIgnoreFiles(const std::vector<std::string>& names)
+            {
+                m_opts.ignore_files = names;
+            }
+
+            /*
+            * stay on the filesystems the start directories are on.
+            * see Config::one_filesystem.
+            */
+            void setOneFilesystem(bool b)
+            {
+                m_opts.one_filesystem = b;
+            }
+
+            /*
+            * skip (or, if $defer is true, put off until the end) mounts that turn out
+            * to be slow. see Config::mount_budget.
+            */
+            void setMountBudget(std::chrono::milliseconds budget, bool defer=false)
+            {
+                m_opts.mount_budget = budget;
+                m_opts.defer_slow_mounts = defer;
+            }
+
+            /*
+            * the mounts that went over the budget during the last walk, as the first
+            * directory on each of them that did.
+            */
+            std::vector<std::filesystem::path> slowMounts()
+            {
+                std::vector<std::filesystem::path> rt;
+                std::lock_guard<std::mutex> lock(m_mountmutex);
+                for(const auto& slow: m_slowmounts)
+                {
+                    rt.push_back(slow.second);
+                }
+                return rt;
+            }
+
             void addDirectory(const std::filesystem::path& path)
             {
                 m_startdirs.push_back(path);
@@ -423,21 +2480,146 @@ namespace Find
                 m_ignfilefuncs.push_back(fn);
             }
 
+            /*
+            * directories matching any of these rules are pruned, files matching any
+            * of ignoreRules() are not emitted - see NameRules.
+            * unlike pruneIf() and ignoreIf(), these are checked against the bytes of the
+            * path, before anything else, and cost about the same for a hundred rules as for one.
+            */
+            NameRules& pruneRules()
+            {
+                return m_prunerules;
+            }
+
+            NameRules& ignoreRules()
+            {
+                return m_ignorerules;
+            }
+
+            /*
+            * $fn is called for every directory that can't be opened or read, every entry that
+            * can't be stat'd, and every exception a callback throws - the walk then carries on.
+            * nothing is thrown to get there, so a tree full of unreadable directories and
+            * dangling symlinks walks about as fast as any other.
+            * like the walk callback, it may be called from any thread (but never concurrently);
+            * WalkError::worker says which.
+            */
+            void onError(ErrorFunc fn)
+            {
+                m_errorfunc = std::move(fn);
+            }
+
+            /*
+            * the same errors, as exceptions, for code that was written against this before
+            * onError() existed: the walker's own errors are made into a filesystem_error first,
+            * which costs a few allocations each. only used if there's no error callback.
+            */
             void onException(ExceptionFunc fn)
             {
                 m_exceptionfunc = std::move(fn);
             }
 
+            /*
+            * see Config::throw_errors.
+            */
+            void setThrowErrors(bool b)
+            {
+                m_opts.throw_errors = b;
+            }
+
+            /*
+            * $fn(dir, depth, worker) is called once every entry of a directory has been
+            * passed to the walk callback, and its subdirectories have been queued (but not
+            * necessarily read yet).
+            * together with the directories the walk callback sees, this tells when a whole
+            * subtree is done: once its own directory is, and each of its subdirectories' subtrees.
+            * with more than one thread, this is called concurrently, like the walk callback.
+            */
+            void onDirectoryDone(DirDoneFunc fn)
+            {
+                m_dirdonefunc = std::move(fn);
+            }
+
             void walk(const EachFunc& fn)
             {
+                walkEntries([&](const Entry& ent)
+                {
+                    fn(ent.path());
+                });
+            }
+
+            /*
+            * like walk(), but the callback receives everything the walker knows about
+            * the entry, which saves having to stat() it again.
+            */
+            void walkEntries(const EntryFunc& fn)
+            {
+                walkVisit([&](const Entry& ent)
+                {
+                    fn(ent);
+                    return true;
+                });
+            }
+
+            /*
+            * like walkEntries(), but the callback also decides whether directories are
+            * descended into. see VisitFunc.
+            */
+            void walkVisit(const VisitFunc& fn)
+            {
+                size_t nthreads;
+                std::vector<Detail::WalkItem> items;
+                std::chrono::steady_clock::time_point started;
                 if(m_startdirs.empty())
                 {
                     m_startdirs.push_back(std::filesystem::current_path());
                 }
+                nthreads = threadCount();
+                #if FIND_STATS
+                    m_statshards.assign(nthreads, Detail::StatsShard());
+                    for(auto& sh: m_statshards)
+                    {
+                        sh.reset(m_opts.time_stats);
+                    }
+                    m_errors = 0;
+                #endif
+                if(m_tracer != nullptr)
+                {
+                    m_tracer->prepare(nthreads);
+                }
+                // slow mounts are found anew by every walk; see slowMounts()
+                {
+                    std::lock_guard<std::mutex> lock(m_mountmutex);
+                    m_slowmounts.clear();
+                    m_deferred.clear();
+                    m_slowcount = 0;
+                }
+                started = std::chrono::steady_clock::now();
                 for(const auto& dir: m_startdirs)
                 {
-                    doWalk(dir, fn);
+                    items.push_back(Detail::WalkItem{dir, 0, nullptr, 0, false});
+                }
+                /*
+                * directories on slow mounts that were put off come back as deferred items,
+                * which have no budget - so this goes around at most twice.
+                */
+                while(!items.empty())
+                {
+                    if(nthreads > 1)
+                    {
+                        doParallelWalk(items, fn, nthreads);
+                    }
+                    else
+                    {
+                        for(const auto& item: items)
+                        {
+                            doWalk(item, fn);
+                        }
+                    }
+                    items.clear();
+                    items.swap(m_deferred);
                 }
+                m_walkns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count());
             }
     };
 }  // namespace Find
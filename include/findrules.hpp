@@ -0,0 +1,1043 @@
+
+/*
+* compiled name matching for the walker: wildcard patterns, and sets of rules
+* (like the ones in a .gitignore) that are tested against the bytes of a path.
+*/
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <array>
+#include <algorithm>
+#include <unordered_set>
+#include <memory>
+#include <cstdint>
+#include <cstdio>
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+namespace Find
+{
+    namespace Detail
+    {
+        constexpr char asciiLowerChar(char ch)
+        {
+            return (((ch >= 'A') && (ch <= 'Z')) ? char(ch + ('a' - 'A')) : ch);
+        }
+
+        constexpr bool isSeparator(char ch)
+        {
+            #if defined(_WIN32)
+                return ((ch == '/') || (ch == '\\'));
+            #else
+                return (ch == '/');
+            #endif
+        }
+
+        // the last component of $path. unlike std::filesystem, "foo/" yields "", not "."
+        inline std::string_view baseName(std::string_view path)
+        {
+            size_t i;
+            for(i=path.size(); i>0; i--)
+            {
+                if(isSeparator(path[i - 1]))
+                {
+                    return path.substr(i);
+                }
+            }
+            return path;
+        }
+    }
+
+    /*
+    * a shell wildcard pattern ('*', '?', '[abc]', '[!a-z]', and '\' to escape), compiled
+    * once, and then matched against any number of strings.
+    * like fnmatch() without any flags, '*' also matches '/' and leading dots.
+    * the most common shapes - "foo", "foo*", "*.o", "*foo*" and "*" - are recognized
+    * when compiling, and matched with a plain comparison instead of the general matcher.
+    *
+    * in pathname mode (what .gitignore uses for patterns with a '/' in them), '*', '?'
+    * and '[...]' never match a '/'. instead, a "**" component matches any number of
+    * directories (including none) - or, at the very end, everything.
+    */
+    class GlobPattern
+    {
+        private:
+            enum class Kind
+            {
+                // no wildcards at all: compared as a whole
+                Literal,
+
+                // "foo*"
+                Prefix,
+
+                // "*foo"
+                Suffix,
+
+                // "*foo*"
+                Contains,
+
+                // "*", or any number of them
+                Any,
+
+                // everything else
+                General,
+            };
+
+            struct Token
+            {
+                enum Type
+                {
+                    Char,
+                    AnyChar,
+                    Star,
+                    Class,
+
+                    // pathname mode only: "**", which matches anything, including '/'
+                    DoubleStar,
+
+                    // pathname mode only: "**/", which matches "", or anything that ends in '/'
+                    DirStar,
+                };
+
+                Type type;
+                char ch;
+                // index into m_classes, for Type::Class
+                size_t cls;
+            };
+
+            // a 256-bit set of the bytes a '[...]' matches
+            using CharClass = std::array<uint64_t, 4>;
+
+        private:
+            std::string m_source;
+            Kind m_kind = Kind::Literal;
+            bool m_icase = false;
+            bool m_pathname = false;
+            // for all kinds but General: the pattern without its stars
+            std::string m_literal;
+            std::vector<Token> m_tokens;
+            std::vector<CharClass> m_classes;
+
+        private:
+            static void classAdd(CharClass& cls, unsigned char ch)
+            {
+                cls[ch / 64] |= (uint64_t(1) << (ch % 64));
+            }
+
+            static bool classHas(const CharClass& cls, unsigned char ch)
+            {
+                return ((cls[ch / 64] & (uint64_t(1) << (ch % 64))) != 0);
+            }
+
+            char fold(char ch) const
+            {
+                return (m_icase ? Detail::asciiLowerChar(ch) : ch);
+            }
+
+            /*
+            * parses the bracket expression starting at $pat[$pos] (which is the '[').
+            * returns false if it isn't terminated, in which case the '[' is just a character.
+            */
+            bool parseClass(std::string_view pat, size_t& pos, CharClass& cls) const
+            {
+                size_t i;
+                size_t ch;
+                bool negate;
+                unsigned char lo;
+                unsigned char hi;
+                CharClass tmp = {};
+                i = (pos + 1);
+                negate = false;
+                if((i < pat.size()) && ((pat[i] == '!') || (pat[i] == '^')))
+                {
+                    negate = true;
+                    i++;
+                }
+                // a ']' right at the start is part of the set
+                if((i < pat.size()) && (pat[i] == ']'))
+                {
+                    classAdd(tmp, ']');
+                    i++;
+                }
+                while((i < pat.size()) && (pat[i] != ']'))
+                {
+                    lo = pat[i];
+                    if(((i + 2) < pat.size()) && (pat[i + 1] == '-') && (pat[i + 2] != ']'))
+                    {
+                        hi = pat[i + 2];
+                        i += 3;
+                    }
+                    else
+                    {
+                        hi = lo;
+                        i += 1;
+                    }
+                    for(ch=lo; ch<=hi; ch++)
+                    {
+                        classAdd(tmp, ch);
+                        if(m_icase)
+                        {
+                            classAdd(tmp, Detail::asciiLowerChar(char(ch)));
+                        }
+                    }
+                }
+                if(i >= pat.size())
+                {
+                    return false;
+                }
+                if(negate)
+                {
+                    for(auto& word: tmp)
+                    {
+                        word = ~word;
+                    }
+                }
+                cls = tmp;
+                pos = (i + 1);
+                return true;
+            }
+
+            void tokenize(std::string_view pat)
+            {
+                size_t pos;
+                size_t first;
+                CharClass cls;
+                pos = 0;
+                while(pos < pat.size())
+                {
+                    if(m_pathname && (pat[pos] == '*') && ((pos + 1) < pat.size()) && (pat[pos + 1] == '*'))
+                    {
+                        /*
+                        * two or more stars only mean something special if they make up a
+                        * whole component; otherwise, they're just a single star.
+                        */
+                        first = pos;
+                        while((pos < pat.size()) && (pat[pos] == '*'))
+                        {
+                            pos++;
+                        }
+                        if((first > 0) && !Detail::isSeparator(pat[first - 1]))
+                        {
+                            m_tokens.push_back(Token{Token::Star, 0, 0});
+                        }
+                        else if(pos == pat.size())
+                        {
+                            m_tokens.push_back(Token{Token::DoubleStar, 0, 0});
+                        }
+                        else if(Detail::isSeparator(pat[pos]))
+                        {
+                            m_tokens.push_back(Token{Token::DirStar, 0, 0});
+                            pos++;
+                        }
+                        else
+                        {
+                            m_tokens.push_back(Token{Token::Star, 0, 0});
+                        }
+                    }
+                    else if(pat[pos] == '*')
+                    {
+                        // consecutive stars are no different from a single one
+                        if(m_tokens.empty() || (m_tokens.back().type != Token::Star))
+                        {
+                            m_tokens.push_back(Token{Token::Star, 0, 0});
+                        }
+                        pos++;
+                    }
+                    else if(pat[pos] == '?')
+                    {
+                        m_tokens.push_back(Token{Token::AnyChar, 0, 0});
+                        pos++;
+                    }
+                    else if((pat[pos] == '[') && parseClass(pat, pos, cls))
+                    {
+                        m_classes.push_back(cls);
+                        m_tokens.push_back(Token{Token::Class, 0, m_classes.size() - 1});
+                    }
+                    else
+                    {
+                        if((pat[pos] == '\\') && ((pos + 1) < pat.size()))
+                        {
+                            pos++;
+                        }
+                        m_tokens.push_back(Token{Token::Char, fold(pat[pos]), 0});
+                        pos++;
+                    }
+                }
+            }
+
+            /*
+            * figures out whether the pattern is one of the simple shapes, i.e., whether it
+            * consists of characters, with stars only at the ends.
+            */
+            void classify()
+            {
+                size_t i;
+                size_t first;
+                size_t last;
+                bool leading;
+                bool trailing;
+                leading = (!m_tokens.empty() && (m_tokens.front().type == Token::Star));
+                trailing = ((m_tokens.size() > (leading ? 1 : 0)) && (m_tokens.back().type == Token::Star));
+                first = (leading ? 1 : 0);
+                last = (m_tokens.size() - (trailing ? 1 : 0));
+                m_literal.clear();
+                // in pathname mode, a star must not cross a '/', which the plain comparisons can't tell
+                if(m_pathname && (leading || trailing))
+                {
+                    m_kind = Kind::General;
+                    return;
+                }
+                for(i=first; i<last; i++)
+                {
+                    if(m_tokens[i].type != Token::Char)
+                    {
+                        m_kind = Kind::General;
+                        return;
+                    }
+                    m_literal.push_back(m_tokens[i].ch);
+                }
+                if(leading && m_literal.empty())
+                {
+                    m_kind = Kind::Any;
+                }
+                else if(leading && trailing)
+                {
+                    m_kind = Kind::Contains;
+                }
+                else if(leading)
+                {
+                    m_kind = Kind::Suffix;
+                }
+                else if(trailing)
+                {
+                    m_kind = Kind::Prefix;
+                }
+                else
+                {
+                    m_kind = Kind::Literal;
+                }
+            }
+
+            bool sameAt(std::string_view str, size_t ofs) const
+            {
+                size_t i;
+                for(i=0; i<m_literal.size(); i++)
+                {
+                    if(fold(str[ofs + i]) != m_literal[i])
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            bool tokenMatches(const Token& tok, char ch) const
+            {
+                switch(tok.type)
+                {
+                    case Token::Char:
+                        return (fold(ch) == tok.ch);
+                    case Token::AnyChar:
+                        return !(m_pathname && Detail::isSeparator(ch));
+                    case Token::Class:
+                        return (!(m_pathname && Detail::isSeparator(ch)) && classHas(m_classes[tok.cls], fold(ch)));
+                    default:
+                        break;
+                }
+                return false;
+            }
+
+            /*
+            * the general case: walks pattern and string side by side, and on a mismatch
+            * backtracks to the last star, letting it swallow one more character.
+            * only the last star ever needs to be retried, so this is linear in practice,
+            * and never worse than O(pattern * string).
+            */
+            bool matchGeneral(std::string_view str) const
+            {
+                size_t ti;
+                size_t si;
+                size_t starti;
+                size_t stars;
+                bool havestar;
+                ti = 0;
+                si = 0;
+                starti = 0;
+                stars = 0;
+                havestar = false;
+                while(si < str.size())
+                {
+                    if(ti < m_tokens.size())
+                    {
+                        if(m_tokens[ti].type == Token::Star)
+                        {
+                            havestar = true;
+                            starti = ti;
+                            stars = si;
+                            ti++;
+                            continue;
+                        }
+                        if(tokenMatches(m_tokens[ti], str[si]))
+                        {
+                            ti++;
+                            si++;
+                            continue;
+                        }
+                    }
+                    if(!havestar)
+                    {
+                        return false;
+                    }
+                    ti = (starti + 1);
+                    stars++;
+                    si = stars;
+                }
+                while((ti < m_tokens.size()) && (m_tokens[ti].type == Token::Star))
+                {
+                    ti++;
+                }
+                return (ti == m_tokens.size());
+            }
+
+            /*
+            * the general case in pathname mode. the different kinds of stars can't share
+            * the single backtracking point of matchGeneral(), so this simply recurses at
+            * every star - like git's wildmatch(), which is fine for the short patterns
+            * this is used for.
+            */
+            bool matchPath(std::string_view str, size_t ti, size_t si) const
+            {
+                size_t k;
+                while(ti < m_tokens.size())
+                {
+                    switch(m_tokens[ti].type)
+                    {
+                        case Token::Star:
+                            for(k=si; true; k++)
+                            {
+                                if(matchPath(str, ti + 1, k))
+                                {
+                                    return true;
+                                }
+                                if((k == str.size()) || Detail::isSeparator(str[k]))
+                                {
+                                    return false;
+                                }
+                            }
+                            break;
+                        case Token::DoubleStar:
+                            for(k=si; k<=str.size(); k++)
+                            {
+                                if(matchPath(str, ti + 1, k))
+                                {
+                                    return true;
+                                }
+                            }
+                            return false;
+                        case Token::DirStar:
+                            if(matchPath(str, ti + 1, si))
+                            {
+                                return true;
+                            }
+                            for(k=si; k<str.size(); k++)
+                            {
+                                if(Detail::isSeparator(str[k]) && matchPath(str, ti + 1, k + 1))
+                                {
+                                    return true;
+                                }
+                            }
+                            return false;
+                        default:
+                            if((si == str.size()) || !tokenMatches(m_tokens[ti], str[si]))
+                            {
+                                return false;
+                            }
+                            ti++;
+                            si++;
+                            break;
+                    }
+                }
+                return (si == str.size());
+            }
+
+        public:
+            GlobPattern()
+            {
+            }
+
+            GlobPattern(std::string_view pat, bool icase=false, bool pathname=false)
+            {
+                compile(pat, icase, pathname);
+            }
+
+            void compile(std::string_view pat, bool icase=false, bool pathname=false)
+            {
+                m_source = std::string(pat);
+                m_icase = icase;
+                m_pathname = pathname;
+                m_tokens.clear();
+                m_classes.clear();
+                tokenize(pat);
+                classify();
+            }
+
+            bool match(std::string_view str) const
+            {
+                size_t i;
+                switch(m_kind)
+                {
+                    case Kind::Literal:
+                        return ((str.size() == m_literal.size()) && sameAt(str, 0));
+                    case Kind::Prefix:
+                        return ((str.size() >= m_literal.size()) && sameAt(str, 0));
+                    case Kind::Suffix:
+                        return ((str.size() >= m_literal.size()) && sameAt(str, str.size() - m_literal.size()));
+                    case Kind::Contains:
+                        for(i=0; (i + m_literal.size()) <= str.size(); i++)
+                        {
+                            if(sameAt(str, i))
+                            {
+                                return true;
+                            }
+                        }
+                        return false;
+                    case Kind::Any:
+                        return true;
+                    case Kind::General:
+                        break;
+                }
+                if(m_pathname)
+                {
+                    return matchPath(str, 0, 0);
+                }
+                return matchGeneral(str);
+            }
+
+            // whether the pattern contains any wildcards at all
+            bool isLiteral() const
+            {
+                return (m_kind == Kind::Literal);
+            }
+
+            const std::string& source() const
+            {
+                return m_source;
+            }
+    };
+
+    /*
+    * a set of rules that names or paths are tested against - like 'find -name' or
+    * 'find -path', or the lines of a .gitignore.
+    *
+    * a rule without a '/' is matched against the last component of a path only, a rule
+    * with one against the whole path (minus any leading "./", on both sides).
+    * rules are sorted into buckets when they're added:
+    *   - plain names ("node_modules") and plain paths go into hash sets,
+    *   - "*.ext" goes into a hash set of extensions,
+    *   - anything else is compiled into a GlobPattern.
+    * so testing a name costs about two hash lookups, no matter how many literal or
+    * extension rules there are; only the remaining wildcard rules are tried one by one.
+    * matching works on the bytes of a path, and never allocates.
+    */
+    class NameRules
+    {
+        private:
+            using StringSet = std::unordered_set<std::string_view>;
+
+        private:
+            bool m_icase;
+
+            // the strings the sets point into. a deque never moves its elements
+            std::deque<std::string> m_storage;
+
+            StringSet m_names;
+            StringSet m_paths;
+            // including the dot
+            StringSet m_exts;
+            std::vector<GlobPattern> m_nameglobs;
+            std::vector<GlobPattern> m_pathglobs;
+
+        private:
+            static bool hasWildcards(std::string_view str)
+            {
+                return (str.find_first_of("*?[\\") != std::string_view::npos);
+            }
+
+            static bool hasSeparator(std::string_view str)
+            {
+                for(char ch: str)
+                {
+                    if(Detail::isSeparator(ch))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            static std::string_view stripDotSlash(std::string_view str)
+            {
+                while((str.size() > 2) && (str[0] == '.') && Detail::isSeparator(str[1]))
+                {
+                    str.remove_prefix(2);
+                }
+                return str;
+            }
+
+            std::string_view keep(std::string_view str)
+            {
+                std::string tmp(str);
+                if(m_icase)
+                {
+                    for(auto& ch: tmp)
+                    {
+                        ch = Detail::asciiLowerChar(ch);
+                    }
+                }
+                m_storage.push_back(std::move(tmp));
+                return m_storage.back();
+            }
+
+            /*
+            * looks up $str in $set, lowercasing it first if need be.
+            * names longer than the stack buffer can't be lowercased, and are looked up as they are.
+            */
+            bool lookup(const StringSet& set, std::string_view str) const
+            {
+                size_t i;
+                char buf[256];
+                if(set.empty())
+                {
+                    return false;
+                }
+                if(m_icase && (str.size() <= sizeof(buf)))
+                {
+                    for(i=0; i<str.size(); i++)
+                    {
+                        buf[i] = Detail::asciiLowerChar(str[i]);
+                    }
+                    str = std::string_view(buf, str.size());
+                }
+                return (set.find(str) != set.end());
+            }
+
+            // like Shared::pathExtension(): from the last dot on, including a leading one
+            static std::string_view extensionOf(std::string_view name)
+            {
+                size_t pos;
+                pos = name.rfind('.');
+                if((pos == std::string_view::npos) || (name == ".") || (name == ".."))
+                {
+                    return std::string_view();
+                }
+                return name.substr(pos);
+            }
+
+        public:
+            NameRules(bool icase=false): m_icase(icase)
+            {
+            }
+
+            // the sets point into m_storage, so a copy would point into the original
+            NameRules(const NameRules&) = delete;
+            NameRules& operator=(const NameRules&) = delete;
+            NameRules(NameRules&&) = default;
+            NameRules& operator=(NameRules&&) = default;
+
+            /*
+            * adds a rule. empty rules, and trailing separators ("build/") are ignored.
+            */
+            void add(std::string_view rule)
+            {
+                while(!rule.empty() && Detail::isSeparator(rule.back()))
+                {
+                    rule.remove_suffix(1);
+                }
+                rule = stripDotSlash(rule);
+                if(rule.empty())
+                {
+                    return;
+                }
+                if(hasSeparator(rule))
+                {
+                    if(hasWildcards(rule))
+                    {
+                        m_pathglobs.emplace_back(rule, m_icase);
+                    }
+                    else
+                    {
+                        m_paths.insert(keep(rule));
+                    }
+                }
+                else if(!hasWildcards(rule))
+                {
+                    m_names.insert(keep(rule));
+                }
+                else if((rule.size() > 2) && (rule[0] == '*') && (rule[1] == '.') && !hasWildcards(rule.substr(1)) && (rule.find('.', 2) == std::string_view::npos))
+                {
+                    m_exts.insert(keep(rule.substr(1)));
+                }
+                else
+                {
+                    m_nameglobs.emplace_back(rule, m_icase);
+                }
+            }
+
+            bool empty() const
+            {
+                return (
+                    m_names.empty() && m_paths.empty() && m_exts.empty() &&
+                    m_nameglobs.empty() && m_pathglobs.empty()
+                );
+            }
+
+            // whether $path (the bytes of a path, as the walker built it) matches any rule
+            bool match(std::string_view path) const
+            {
+                std::string_view name;
+                std::string_view rel;
+                name = Detail::baseName(path);
+                if(lookup(m_names, name))
+                {
+                    return true;
+                }
+                if(!m_exts.empty())
+                {
+                    auto ext = extensionOf(name);
+                    if(!ext.empty() && lookup(m_exts, ext))
+                    {
+                        return true;
+                    }
+                }
+                for(const auto& glob: m_nameglobs)
+                {
+                    if(glob.match(name))
+                    {
+                        return true;
+                    }
+                }
+                if(!(m_paths.empty() && m_pathglobs.empty()))
+                {
+                    rel = stripDotSlash(path);
+                    if(lookup(m_paths, rel))
+                    {
+                        return true;
+                    }
+                    for(const auto& glob: m_pathglobs)
+                    {
+                        if(glob.match(rel))
+                        {
+                            return true;
+                        }
+                    }
+                }
+                return false;
+            }
+    };
+
+    /*
+    * the compiled rules of a single .gitignore (or .ignore) file.
+    * follows gitignore(5): blank lines and '#' comments are skipped, '!' negates a rule,
+    * a trailing '/' makes it match directories only, and a rule with a '/' anywhere else
+    * is anchored to the directory the file is in, and matched in pathname mode against
+    * the path relative to it. any other rule is matched against the name alone.
+    * the last rule that matches decides - but as long as there are no negated rules,
+    * the order doesn't matter, and the name rules are looked up in NameRules sets instead.
+    */
+    class GitIgnore
+    {
+        public:
+            enum class Verdict
+            {
+                // no rule matched; ask the .gitignore of the parent directory
+                None,
+                Ignore,
+
+                // a negated rule matched
+                Keep,
+            };
+
+        private:
+            struct Rule
+            {
+                GlobPattern pattern;
+                bool negate;
+                bool dironly;
+                bool anchored;
+            };
+
+        private:
+            std::vector<Rule> m_rules;
+            bool m_hasnegations = false;
+
+            // without negations: the unanchored rules, for anything, and for directories only
+            NameRules m_names;
+            NameRules m_dirnames;
+            // indexes into m_rules
+            std::vector<size_t> m_anchored;
+
+        private:
+            bool ruleMatches(const Rule& rule, std::string_view rel, std::string_view name, bool isdir) const
+            {
+                if(rule.dironly && !isdir)
+                {
+                    return false;
+                }
+                return rule.pattern.match(rule.anchored ? rel : name);
+            }
+
+        public:
+            // adds a single line of a .gitignore
+            void addLine(std::string_view line)
+            {
+                bool negate;
+                bool dironly;
+                bool anchored;
+                if(!line.empty() && (line.back() == '\r'))
+                {
+                    line.remove_suffix(1);
+                }
+                // trailing spaces are ignored, unless escaped
+                while(!line.empty() && (line.back() == ' ') && !((line.size() > 1) && (line[line.size() - 2] == '\\')))
+                {
+                    line.remove_suffix(1);
+                }
+                if(line.empty() || (line[0] == '#'))
+                {
+                    return;
+                }
+                negate = false;
+                if(line[0] == '!')
+                {
+                    negate = true;
+                    line.remove_prefix(1);
+                }
+                dironly = false;
+                while(!line.empty() && (line.back() == '/'))
+                {
+                    dironly = true;
+                    line.remove_suffix(1);
+                }
+                anchored = (line.find('/') != std::string_view::npos);
+                while(!line.empty() && (line[0] == '/'))
+                {
+                    line.remove_prefix(1);
+                }
+                if(line.empty())
+                {
+                    return;
+                }
+                m_rules.push_back(Rule{GlobPattern(line, false, anchored), negate, dironly, anchored});
+                m_hasnegations = (m_hasnegations || negate);
+                if(anchored)
+                {
+                    m_anchored.push_back(m_rules.size() - 1);
+                }
+                else
+                {
+                    (dironly ? m_dirnames : m_names).add(line);
+                }
+            }
+
+            // adds every line of $text
+            void parse(std::string_view text)
+            {
+                size_t pos;
+                while(!text.empty())
+                {
+                    pos = text.find('\n');
+                    if(pos == std::string_view::npos)
+                    {
+                        addLine(text);
+                        break;
+                    }
+                    addLine(text.substr(0, pos));
+                    text.remove_prefix(pos + 1);
+                }
+            }
+
+            /*
+            * appends the contents of the file at $path to $text.
+            * returns false if it can't be opened - which, for a .gitignore, usually just
+            * means that there is none.
+            */
+            static bool readFile(const std::string& path, std::string& text)
+            {
+                char buf[4096];
+                #if defined(__unix__) || defined(__APPLE__)
+                    /*
+                    * most directories don't have one, and a failed open() costs a fraction
+                    * of what a failed fopen() does - which adds up when it's done for
+                    * every directory of the walk.
+                    */
+                    ssize_t n;
+                    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                    if(fd == -1)
+                    {
+                        return false;
+                    }
+                    while((n = read(fd, buf, sizeof(buf))) > 0)
+                    {
+                        text.append(buf, n);
+                    }
+                    close(fd);
+                #else
+                    size_t n;
+                    FILE* fh = std::fopen(path.c_str(), "rb");
+                    if(fh == nullptr)
+                    {
+                        return false;
+                    }
+                    while((n = std::fread(buf, 1, sizeof(buf), fh)) > 0)
+                    {
+                        text.append(buf, n);
+                    }
+                    std::fclose(fh);
+                #endif
+                return true;
+            }
+
+            // reads and parses the file at $path
+            bool load(const std::string& path)
+            {
+                std::string text;
+                if(!readFile(path, text))
+                {
+                    return false;
+                }
+                parse(text);
+                return true;
+            }
+
+            bool empty() const
+            {
+                return m_rules.empty();
+            }
+
+            /*
+            * what the rules say about $rel, the path of an entry relative to the
+            * directory of the file.
+            */
+            Verdict match(std::string_view rel, bool isdir) const
+            {
+                size_t i;
+                std::string_view name;
+                name = Detail::baseName(rel);
+                if(!m_hasnegations)
+                {
+                    if(m_names.match(name) || (isdir && m_dirnames.match(name)))
+                    {
+                        return Verdict::Ignore;
+                    }
+                    for(size_t idx: m_anchored)
+                    {
+                        if(ruleMatches(m_rules[idx], rel, name, isdir))
+                        {
+                            return Verdict::Ignore;
+                        }
+                    }
+                    return Verdict::None;
+                }
+                for(i=m_rules.size(); i>0; i--)
+                {
+                    const auto& rule = m_rules[i - 1];
+                    if(ruleMatches(rule, rel, name, isdir))
+                    {
+                        return (rule.negate ? Verdict::Keep : Verdict::Ignore);
+                    }
+                }
+                return Verdict::None;
+            }
+    };
+
+    /*
+    * one level of the stack of ignore files the walker keeps: the rules of the ignore
+    * files in one directory, and a pointer to the level above.
+    * directories without any ignore file simply share their parent's level, so the
+    * stack is only as deep as the number of ignore files above an entry, and every
+    * file is read and compiled once, no matter how many entries it's checked against.
+    * levels are immutable once built, which lets the parallel walker share them between
+    * threads.
+    */
+    class IgnoreScope
+    {
+        public:
+            using Ptr = std::shared_ptr<const IgnoreScope>;
+
+        private:
+            Ptr m_parent;
+            GitIgnore m_rules;
+
+            // the length of the directory's path, including the separator that follows it
+            size_t m_baselen = 0;
+
+        public:
+            /*
+            * the level for $dir (the bytes of its path, as the walker uses it): $parent,
+            * plus whatever is in the files named $filenames in $dir. files later in
+            * $filenames take precedence.
+            */
+            static Ptr enter(std::string_view dir, const Ptr& parent, const std::vector<std::string>& filenames)
+            {
+                size_t baselen;
+                std::string path;
+                std::string text;
+                path = std::string(dir);
+                if(!path.empty() && !Detail::isSeparator(path.back()))
+                {
+                    path.push_back('/');
+                }
+                baselen = path.size();
+                for(const auto& name: filenames)
+                {
+                    path.resize(baselen);
+                    path.append(name);
+                    if(GitIgnore::readFile(path, text))
+                    {
+                        text.push_back('\n');
+                    }
+                }
+                // the usual case, which shouldn't cost more than the failed open()s
+                if(text.empty())
+                {
+                    return parent;
+                }
+                auto scope = std::make_shared<IgnoreScope>();
+                scope->m_rules.parse(text);
+                if(scope->m_rules.empty())
+                {
+                    return parent;
+                }
+                scope->m_parent = parent;
+                scope->m_baselen = baselen;
+                return scope;
+            }
+
+            /*
+            * whether $path (which must be inside the directory this level was entered for)
+            * is ignored: the innermost ignore file with a matching rule decides.
+            */
+            bool ignored(std::string_view path, bool isdir) const
+            {
+                const IgnoreScope* level;
+                for(level=this; level!=nullptr; level=level->m_parent.get())
+                {
+                    switch(level->m_rules.match(path.substr(std::min(level->m_baselen, path.size())), isdir))
+                    {
+                        case GitIgnore::Verdict::Ignore:
+                            return true;
+                        case GitIgnore::Verdict::Keep:
+                            return false;
+                        case GitIgnore::Verdict::None:
+                            break;
+                    }
+                }
+                return false;
+            }
+    };
+}
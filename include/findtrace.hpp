@@ -0,0 +1,423 @@
+
+/*
+* a timeline of what the walker did, per thread: spans for reading each directory
+* (and opening, reading and closing it), statx batches, and callbacks - written out
+* as a Chrome trace (chrome://tracing, or ui.perfetto.dev), and summed up as the
+* slowest directories. see Finder::setTracer().
+*/
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+namespace Find
+{
+    class Tracer;
+
+    namespace Detail
+    {
+        /*
+        * the spans of one walker thread, in a ring: once it is full, the oldest spans
+        * are overwritten. only ever written by its own thread, and only read once the
+        * walk is over - so recording a span is a couple of stores, without locks or atomics.
+        * the path of a span is that of the directory it happened in: paths are kept in
+        * a ring of their own (one entry per directory, reusing the strings' memory), and
+        * a span whose directory has been overwritten already is written without one.
+        */
+        class TraceBuffer
+        {
+            public:
+                enum class Kind: uint32_t
+                {
+                    // everything that happened for one directory; the other spans nest in it
+                    Directory,
+                    Open,
+                    Read,
+                    Close,
+                    StatBatch,
+                    Callback,
+                };
+
+                struct Span
+                {
+                    // nanoseconds since the tracer was made
+                    int64_t start;
+                    int64_t duration;
+
+                    // sequence number of the directory (see enterDirectory())
+                    uint64_t dir;
+
+                    Kind kind;
+
+                    // what the span handled: bytes read, statx requests, ... (0 if nothing in particular)
+                    uint32_t count;
+                };
+
+                struct SlowDirectory
+                {
+                    std::string path;
+                    int64_t duration;
+                    size_t thread;
+                };
+
+            private:
+                std::vector<Span> m_spans;
+                uint64_t m_written = 0;
+                std::vector<std::string> m_dirs;
+                uint64_t m_dirseq = 0;
+                uint64_t m_curdir = 0;
+
+                // the slowest directories seen so far, as a heap that has the fastest of them on top
+                std::vector<SlowDirectory> m_slowest;
+                size_t m_keepslowest;
+                size_t m_thread;
+
+            private:
+                static bool slower(const SlowDirectory& lhs, const SlowDirectory& rhs)
+                {
+                    return (lhs.duration > rhs.duration);
+                }
+
+            public:
+                TraceBuffer(size_t thread, size_t capacity, size_t keepslowest):
+                    m_spans(std::max(size_t(1), capacity)), m_dirs(std::max(size_t(1), capacity / 8)),
+                    m_keepslowest(keepslowest), m_thread(thread)
+                {
+                }
+
+                /*
+                * starts the spans of directory $path; returns its sequence number, which
+                * leaveDirectory() wants back.
+                */
+                uint64_t enterDirectory(std::string_view path)
+                {
+                    m_curdir = m_dirseq++;
+                    m_dirs[m_curdir % m_dirs.size()].assign(path.data(), path.size());
+                    return m_curdir;
+                }
+
+                void leaveDirectory(uint64_t dir, int64_t start, int64_t end)
+                {
+                    const std::string& path = m_dirs[dir % m_dirs.size()];
+                    m_curdir = dir;
+                    record(Kind::Directory, start, end, 0);
+                    if(m_keepslowest == 0)
+                    {
+                        return;
+                    }
+                    if(m_slowest.size() < m_keepslowest)
+                    {
+                        m_slowest.push_back(SlowDirectory{path, (end - start), m_thread});
+                        std::push_heap(m_slowest.begin(), m_slowest.end(), slower);
+                    }
+                    else if((end - start) > m_slowest.front().duration)
+                    {
+                        std::pop_heap(m_slowest.begin(), m_slowest.end(), slower);
+                        m_slowest.back().path = path;
+                        m_slowest.back().duration = (end - start);
+                        std::push_heap(m_slowest.begin(), m_slowest.end(), slower);
+                    }
+                }
+
+                void record(Kind kind, int64_t start, int64_t end, uint32_t count)
+                {
+                    Span& sp = m_spans[m_written % m_spans.size()];
+                    sp.start = start;
+                    sp.duration = (end - start);
+                    sp.dir = m_curdir;
+                    sp.kind = kind;
+                    sp.count = count;
+                    m_written++;
+                }
+
+                size_t thread() const
+                {
+                    return m_thread;
+                }
+
+                // spans that were overwritten
+                uint64_t dropped() const
+                {
+                    return ((m_written > m_spans.size()) ? (m_written - m_spans.size()) : 0);
+                }
+
+                // calls $fn(span, path) for every span still in the ring, oldest first; $path may be null
+                template<typename FuncT>
+                void each(FuncT&& fn) const
+                {
+                    uint64_t i;
+                    const std::string* path;
+                    for(i=dropped(); i<m_written; i++)
+                    {
+                        const Span& sp = m_spans[i % m_spans.size()];
+                        path = nullptr;
+                        if((sp.dir < m_dirseq) && ((m_dirseq - sp.dir) <= m_dirs.size()))
+                        {
+                            path = &m_dirs[sp.dir % m_dirs.size()];
+                        }
+                        fn(sp, path);
+                    }
+                }
+
+                const std::vector<SlowDirectory>& slowest() const
+                {
+                    return m_slowest;
+                }
+        };
+    }
+
+    /*
+    * collects the spans of every walk of every Finder it is given to, until it is written out.
+    * the caller owns it (like a DirIndex), and must not share it between walks that run
+    * at the same time.
+    * with tracing, every span costs two clock reads and a few stores; without
+    * (the default), the walker only checks for a null pointer.
+    */
+    class Tracer
+    {
+        public:
+            using Clock = std::chrono::steady_clock;
+            using Kind = Detail::TraceBuffer::Kind;
+            using SlowDirectory = Detail::TraceBuffer::SlowDirectory;
+
+        private:
+            Clock::time_point m_epoch;
+            size_t m_capacity;
+            size_t m_keepslowest;
+            std::vector<std::unique_ptr<Detail::TraceBuffer>> m_buffers;
+
+        private:
+            static const char* kindName(Kind kind)
+            {
+                switch(kind)
+                {
+                    case Kind::Directory:
+                        return "directory";
+                    case Kind::Open:
+                        return "open";
+                    case Kind::Read:
+                        return "read";
+                    case Kind::Close:
+                        return "close";
+                    case Kind::StatBatch:
+                        return "statx batch";
+                    case Kind::Callback:
+                        return "callback";
+                }
+                return "?";
+            }
+
+            static void writeEscaped(FILE* fh, std::string_view str)
+            {
+                for(unsigned char ch: str)
+                {
+                    if((ch == '"') || (ch == '\\'))
+                    {
+                        std::fputc('\\', fh);
+                        std::fputc(ch, fh);
+                    }
+                    else if(ch < 0x20)
+                    {
+                        std::fprintf(fh, "\\u%04x", unsigned(ch));
+                    }
+                    else
+                    {
+                        std::fputc(ch, fh);
+                    }
+                }
+            }
+
+        public:
+            /*
+            * every thread keeps its last $capacity spans (32 bytes each), and its $keepslowest
+            * slowest directories.
+            */
+            Tracer(size_t capacity=(1024 * 256), size_t keepslowest=32):
+                m_epoch(Clock::now()), m_capacity(capacity), m_keepslowest(keepslowest)
+            {
+            }
+
+            Tracer(const Tracer&) = delete;
+            Tracer& operator=(const Tracer&) = delete;
+
+            int64_t now() const
+            {
+                return int64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_epoch).count());
+            }
+
+            // makes sure there's a buffer for each of $nthreads threads; called before a walk starts
+            void prepare(size_t nthreads)
+            {
+                while(m_buffers.size() < nthreads)
+                {
+                    m_buffers.emplace_back(new Detail::TraceBuffer(m_buffers.size(), m_capacity, m_keepslowest));
+                }
+            }
+
+            Detail::TraceBuffer* buffer(size_t thread)
+            {
+                return m_buffers[thread].get();
+            }
+
+            uint64_t dropped() const
+            {
+                uint64_t n;
+                n = 0;
+                for(const auto& buf: m_buffers)
+                {
+                    n += buf->dropped();
+                }
+                return n;
+            }
+
+            // the $n slowest directories over all threads, slowest first
+            std::vector<SlowDirectory> slowest(size_t n) const
+            {
+                std::vector<SlowDirectory> rt;
+                for(const auto& buf: m_buffers)
+                {
+                    rt.insert(rt.end(), buf->slowest().begin(), buf->slowest().end());
+                }
+                std::sort(rt.begin(), rt.end(), [](const SlowDirectory& lhs, const SlowDirectory& rhs)
+                {
+                    return (lhs.duration > rhs.duration);
+                });
+                if(rt.size() > n)
+                {
+                    rt.resize(n);
+                }
+                return rt;
+            }
+
+            /*
+            * writes every span as a Chrome trace ("X" events, one track per walker thread) to $path.
+            * returns false if it couldn't be written.
+            */
+            bool writeChromeTrace(const std::string& path) const
+            {
+                bool first;
+                bool ok;
+                FILE* fh;
+                fh = std::fopen(path.c_str(), "wb");
+                if(fh == nullptr)
+                {
+                    return false;
+                }
+                first = true;
+                std::fprintf(fh, "{\"displayTimeUnit\": \"ns\", \"otherData\": {\"dropped_spans\": %llu}, \"traceEvents\": [\n",
+                    (unsigned long long)dropped());
+                for(const auto& buf: m_buffers)
+                {
+                    std::fprintf(fh, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, \"args\": {\"name\": \"walker %zu\"}}",
+                        (first ? "" : ",\n"), buf->thread(), buf->thread());
+                    first = false;
+                    buf->each([&](const Detail::TraceBuffer::Span& sp, const std::string* dir)
+                    {
+                        std::fprintf(fh, ",\n{\"name\": \"%s\", \"cat\": \"walk\", \"ph\": \"X\", \"pid\": 1, \"tid\": %zu, \"ts\": %.3f, \"dur\": %.3f, \"args\": {",
+                            kindName(sp.kind), buf->thread(), (double(sp.start) / 1000.0), (double(sp.duration) / 1000.0));
+                        if(dir != nullptr)
+                        {
+                            std::fputs("\"path\": \"", fh);
+                            writeEscaped(fh, *dir);
+                            std::fputs("\"", fh);
+                        }
+                        if(sp.count != 0)
+                        {
+                            std::fprintf(fh, "%s\"count\": %u", ((dir != nullptr) ? ", " : ""), unsigned(sp.count));
+                        }
+                        std::fputs("}}", fh);
+                    });
+                }
+                std::fputs("\n]}\n", fh);
+                ok = (std::ferror(fh) == 0);
+                ok = ((std::fclose(fh) == 0) && ok);
+                return ok;
+            }
+    };
+
+    namespace Detail
+    {
+        /*
+        * a span from its construction until stop() (or its destruction), recorded in
+        * $buf - which may be null, in which case this does nothing at all.
+        */
+        class TraceSpan
+        {
+            private:
+                const Tracer* m_tracer;
+                TraceBuffer* m_buf;
+                TraceBuffer::Kind m_kind;
+                uint32_t m_count = 0;
+                int64_t m_start = 0;
+
+            public:
+                TraceSpan(const Tracer* tracer, TraceBuffer* buf, TraceBuffer::Kind kind): m_tracer(tracer), m_buf(buf), m_kind(kind)
+                {
+                    if(m_buf != nullptr)
+                    {
+                        m_start = m_tracer->now();
+                    }
+                }
+
+                ~TraceSpan()
+                {
+                    stop();
+                }
+
+                TraceSpan(const TraceSpan&) = delete;
+                TraceSpan& operator=(const TraceSpan&) = delete;
+
+                void setCount(uint64_t n)
+                {
+                    m_count = uint32_t(std::min(n, uint64_t(UINT32_MAX)));
+                }
+
+                void stop()
+                {
+                    if(m_buf != nullptr)
+                    {
+                        m_buf->record(m_kind, m_start, m_tracer->now(), m_count);
+                        m_buf = nullptr;
+                    }
+                }
+        };
+
+        /* the span of a whole directory; see TraceBuffer::enterDirectory() */
+        class TraceDirectory
+        {
+            private:
+                const Tracer* m_tracer;
+                TraceBuffer* m_buf;
+                uint64_t m_dir = 0;
+                int64_t m_start = 0;
+
+            public:
+                TraceDirectory(const Tracer* tracer, TraceBuffer* buf, std::string_view path): m_tracer(tracer), m_buf(buf)
+                {
+                    if(m_buf != nullptr)
+                    {
+                        m_dir = m_buf->enterDirectory(path);
+                        m_start = m_tracer->now();
+                    }
+                }
+
+                ~TraceDirectory()
+                {
+                    if(m_buf != nullptr)
+                    {
+                        m_buf->leaveDirectory(m_dir, m_start, m_tracer->now());
+                    }
+                }
+
+                TraceDirectory(const TraceDirectory&) = delete;
+                TraceDirectory& operator=(const TraceDirectory&) = delete;
+        };
+    }
+}
@@ -0,0 +1,336 @@
+
+/*
+* batched statx(2) through io_uring, for walks that stat every entry.
+* talks to the kernel directly (io_uring_setup/io_uring_enter, and mmap'ing the rings),
+* so it needs nothing but the kernel headers. linux only; see Finder::Backend::Uring.
+*/
+
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+namespace Find
+{
+    namespace Detail
+    {
+        /*
+        * one io_uring, used to statx() many names relative to one directory at once:
+        * up to $depth requests are in flight, and each completion makes room for the next one,
+        * so the filesystem sees a steady queue instead of one stat at a time.
+        * not thread-safe - every thread gets its own (see statxRing()).
+        */
+        class StatxRing
+        {
+            public:
+                // the result of a request that never completed (which only happens if the ring broke)
+                static constexpr int Pending = 1;
+
+                struct Request
+                {
+                    const char* name;
+
+                    // 0 on success, -errno on failure, or Pending
+                    int result;
+
+                    struct statx stx;
+                };
+
+            private:
+                int m_fd = -1;
+                unsigned m_depth = 0;
+                void* m_sqmap = MAP_FAILED;
+                size_t m_sqmaplen = 0;
+                void* m_cqmap = MAP_FAILED;
+                size_t m_cqmaplen = 0;
+                io_uring_sqe* m_sqes = nullptr;
+                size_t m_sqeslen = 0;
+                unsigned* m_sqtail = nullptr;
+                unsigned* m_sqmask = nullptr;
+                unsigned* m_sqarray = nullptr;
+                unsigned* m_cqhead = nullptr;
+                unsigned* m_cqtail = nullptr;
+                unsigned* m_cqmask = nullptr;
+                io_uring_cqe* m_cqes = nullptr;
+
+            private:
+                template<typename Type>
+                static Type* at(void* base, uint32_t off)
+                {
+                    return reinterpret_cast<Type*>(static_cast<char*>(base) + off);
+                }
+
+                // whether the kernel knows IORING_OP_STATX (5.6 and later)
+                bool probeStatx()
+                {
+                    size_t len;
+                    bool ok;
+                    io_uring_probe* probe;
+                    len = (sizeof(io_uring_probe) + (256 * sizeof(io_uring_probe_op)));
+                    probe = static_cast<io_uring_probe*>(std::calloc(1, len));
+                    if(probe == nullptr)
+                    {
+                        return false;
+                    }
+                    ok = false;
+                    if(syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, 256) == 0)
+                    {
+                        ok = ((probe->last_op >= IORING_OP_STATX) && ((probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED) != 0));
+                    }
+                    std::free(probe);
+                    return ok;
+                }
+
+                void push(int dirfd, Request& req, size_t idx)
+                {
+                    unsigned tail;
+                    unsigned slot;
+                    io_uring_sqe* sqe;
+                    tail = *m_sqtail;
+                    slot = (tail & *m_sqmask);
+                    sqe = &m_sqes[slot];
+                    std::memset(sqe, 0, sizeof(*sqe));
+                    sqe->opcode = IORING_OP_STATX;
+                    sqe->fd = dirfd;
+                    sqe->addr = reinterpret_cast<uint64_t>(req.name);
+                    sqe->len = STATX_BASIC_STATS;
+                    sqe->off = reinterpret_cast<uint64_t>(&req.stx);
+                    // no AT_SYMLINK_NOFOLLOW: like stat(), this describes what a symlink points to
+                    sqe->statx_flags = 0;
+                    sqe->user_data = idx;
+                    m_sqarray[slot] = slot;
+                    __atomic_store_n(m_sqtail, tail + 1, __ATOMIC_RELEASE);
+                }
+
+                size_t reap(Request* reqs)
+                {
+                    unsigned head;
+                    unsigned tail;
+                    size_t n;
+                    n = 0;
+                    head = *m_cqhead;
+                    tail = __atomic_load_n(m_cqtail, __ATOMIC_ACQUIRE);
+                    for(; head != tail; head++, n++)
+                    {
+                        const io_uring_cqe& cqe = m_cqes[head & *m_cqmask];
+                        reqs[cqe.user_data].result = ((cqe.res > 0) ? 0 : cqe.res);
+                    }
+                    __atomic_store_n(m_cqhead, head, __ATOMIC_RELEASE);
+                    return n;
+                }
+
+            public:
+                StatxRing()
+                {
+                }
+
+                ~StatxRing()
+                {
+                    close();
+                }
+
+                StatxRing(const StatxRing&) = delete;
+                StatxRing& operator=(const StatxRing&) = delete;
+
+                /*
+                * sets up a ring with room for $depth requests.
+                * returns false if io_uring isn't available - too old a kernel, or
+                * disabled (seccomp, sysctl kernel.io_uring_disabled, ...).
+                */
+                bool open(unsigned depth)
+                {
+                    void* sqes;
+                    io_uring_params p;
+                    std::memset(&p, 0, sizeof(p));
+                    m_fd = int(syscall(__NR_io_uring_setup, depth, &p));
+                    if(m_fd < 0)
+                    {
+                        m_fd = -1;
+                        return false;
+                    }
+                    m_depth = p.sq_entries;
+                    m_sqmaplen = (p.sq_off.array + (p.sq_entries * sizeof(unsigned)));
+                    m_cqmaplen = (p.cq_off.cqes + (p.cq_entries * sizeof(io_uring_cqe)));
+                    m_sqeslen = (p.sq_entries * sizeof(io_uring_sqe));
+                    m_sqmap = mmap(nullptr, m_sqmaplen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+                    m_cqmap = mmap(nullptr, m_cqmaplen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+                    sqes = mmap(nullptr, m_sqeslen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+                    if((m_sqmap == MAP_FAILED) || (m_cqmap == MAP_FAILED) || (sqes == MAP_FAILED))
+                    {
+                        if(sqes != MAP_FAILED)
+                        {
+                            munmap(sqes, m_sqeslen);
+                        }
+                        close();
+                        return false;
+                    }
+                    m_sqes = static_cast<io_uring_sqe*>(sqes);
+                    m_sqtail = at<unsigned>(m_sqmap, p.sq_off.tail);
+                    m_sqmask = at<unsigned>(m_sqmap, p.sq_off.ring_mask);
+                    m_sqarray = at<unsigned>(m_sqmap, p.sq_off.array);
+                    m_cqhead = at<unsigned>(m_cqmap, p.cq_off.head);
+                    m_cqtail = at<unsigned>(m_cqmap, p.cq_off.tail);
+                    m_cqmask = at<unsigned>(m_cqmap, p.cq_off.ring_mask);
+                    m_cqes = at<io_uring_cqe>(m_cqmap, p.cq_off.cqes);
+                    if(!probeStatx())
+                    {
+                        close();
+                        return false;
+                    }
+                    return true;
+                }
+
+                bool good() const
+                {
+                    return (m_fd != -1);
+                }
+
+                void close()
+                {
+                    if(m_sqes != nullptr)
+                    {
+                        munmap(m_sqes, m_sqeslen);
+                        m_sqes = nullptr;
+                    }
+                    if(m_sqmap != MAP_FAILED)
+                    {
+                        munmap(m_sqmap, m_sqmaplen);
+                        m_sqmap = MAP_FAILED;
+                    }
+                    if(m_cqmap != MAP_FAILED)
+                    {
+                        munmap(m_cqmap, m_cqmaplen);
+                        m_cqmap = MAP_FAILED;
+                    }
+                    if(m_fd != -1)
+                    {
+                        ::close(m_fd);
+                        m_fd = -1;
+                    }
+                }
+
+                /*
+                * waits for the $inflight requests the kernel still has, and reaps them into $reqs.
+                * returns false if io_uring_enter() fails, and nothing is left to reap -
+                * the kernel may then still write into $reqs at any time.
+                */
+                bool drain(Request* reqs, unsigned& inflight)
+                {
+                    long rc;
+                    size_t n;
+                    while(inflight > 0)
+                    {
+                        rc = syscall(__NR_io_uring_enter, m_fd, 0, inflight, IORING_ENTER_GETEVENTS, nullptr, 0);
+                        n = reap(reqs);
+                        inflight -= unsigned(n);
+                        if((rc < 0) && (errno != EINTR) && (errno != EAGAIN) && (n == 0))
+                        {
+                            return false;
+                        }
+                    }
+                    return true;
+                }
+
+                /*
+                * statx()es every request's name relative to $dirfd, and stores the outcome
+                * in its $result and $stx.
+                * returns false if io_uring_enter() failed for good; the ring is closed then, and
+                * requests that are still Pending are up to the caller.
+                * the ring never gives up while the kernel still has requests: it waits for them
+                * first. if even that fails, $reqs is left to the kernel for good (i.e., leaked),
+                * and replaced with as many fresh requests, all of them Pending.
+                */
+                bool run(int dirfd, std::vector<Request>& reqs)
+                {
+                    size_t i;
+                    size_t next;
+                    size_t done;
+                    size_t count;
+                    unsigned queued;
+                    unsigned inflight;
+                    long rc;
+                    next = 0;
+                    done = 0;
+                    queued = 0;
+                    inflight = 0;
+                    count = reqs.size();
+                    for(i=0; i<count; i++)
+                    {
+                        reqs[i].result = Pending;
+                    }
+                    while(done < count)
+                    {
+                        while((next < count) && ((queued + inflight) < m_depth))
+                        {
+                            push(dirfd, reqs[next], next);
+                            next++;
+                            queued++;
+                        }
+                        // submits whatever is queued, and waits for at least one completion
+                        rc = syscall(__NR_io_uring_enter, m_fd, queued, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                        if(rc < 0)
+                        {
+                            if((errno == EINTR) || (errno == EAGAIN))
+                            {
+                                continue;
+                            }
+                            if(!drain(reqs.data(), inflight))
+                            {
+                                // never freed on purpose: the kernel may still write into it
+                                auto* abandoned = new std::vector<Request>();
+                                abandoned->swap(reqs);
+                                reqs.resize(count);
+                                for(i=0; i<count; i++)
+                                {
+                                    reqs[i].name = (*abandoned)[i].name;
+                                    reqs[i].result = Pending;
+                                }
+                            }
+                            close();
+                            return false;
+                        }
+                        queued -= unsigned(rc);
+                        inflight += unsigned(rc);
+                        rc = reap(reqs.data());
+                        inflight -= unsigned(rc);
+                        done += size_t(rc);
+                    }
+                    return true;
+                }
+        };
+
+        /*
+        * the calling thread's ring, set up on first use; null if io_uring can't be used,
+        * in which case it isn't tried again on this thread.
+        */
+        inline StatxRing* statxRing()
+        {
+            // enough to keep a disk busy, without the ring taking up much memory per thread
+            static constexpr unsigned Depth = 256;
+            static thread_local StatxRing ring;
+            static thread_local bool tried = false;
+            if(!tried)
+            {
+                tried = true;
+                ring.open(Depth);
+            }
+            return (ring.good() ? &ring : nullptr);
+        }
+
+        /* the requests for one getdents batch. one per thread, reused for every directory. */
+        inline std::vector<StatxRing::Request>& statxRequests()
+        {
+            static thread_local std::vector<StatxRing::Request> reqs;
+            return reqs;
+        }
+    }
+}
@@ -0,0 +1,137 @@
+
+/*
+* a tiny harness for microbenchmarks of the per-file/per-line code paths.
+* reports nanoseconds and heap allocations per operation.
+*
+* allocations are counted by replacing the global operator new, so this header
+* must be included by exactly one translation unit per benchmark program.
+*/
+
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace Bench
+{
+    inline std::atomic<size_t> allocations(0);
+
+    struct Result
+    {
+        std::string name;
+        size_t ops = 0;
+        double nsperop = 0;
+        double allocsperop = 0;
+    };
+
+    /*
+    * values that benchmarks feed their results into, so the compiler can't
+    * optimize the work away.
+    */
+    inline void consume(size_t v)
+    {
+        static volatile size_t sink;
+        sink = sink + v;
+    }
+
+    /*
+    * runs $fn (which performs $ops operations per call) until at least $mintime seconds
+    * have passed, and reports the fastest round - the others mostly measure noise.
+    */
+    template<typename FuncT>
+    Result run(const std::string& name, size_t ops, FuncT&& fn, double mintime=0.5)
+    {
+        double elapsed;
+        double best;
+        size_t rounds;
+        size_t allocs;
+        Result res;
+        using Clock = std::chrono::steady_clock;
+        elapsed = 0;
+        best = -1;
+        rounds = 0;
+        allocs = 0;
+        // warm-up round, which also fills caches the kernel may build lazily
+        fn();
+        while((elapsed < mintime) || (rounds < 3))
+        {
+            auto allocsbefore = allocations.load();
+            auto begin = Clock::now();
+            fn();
+            auto took = std::chrono::duration<double>(Clock::now() - begin).count();
+            allocs += (allocations.load() - allocsbefore);
+            elapsed += took;
+            if((best < 0) || (took < best))
+            {
+                best = took;
+            }
+            rounds++;
+        }
+        res.name = name;
+        res.ops = ops;
+        res.nsperop = ((best * 1e9) / double(ops));
+        res.allocsperop = (double(allocs) / double(ops * rounds));
+        return res;
+    }
+
+    inline void print(const Result& res)
+    {
+        std::printf("%-56s %12.2f ns/op %12.0f ops/s %10.3f allocs/op  (%zu ops)\n",
+            res.name.c_str(), res.nsperop, (1e9 / res.nsperop), res.allocsperop, res.ops);
+    }
+
+    inline std::vector<std::string> readLines(const std::string& path)
+    {
+        std::string line;
+        std::vector<std::string> lines;
+        std::fstream fh(path, std::ios::in | std::ios::binary);
+        if(!fh.good())
+        {
+            std::cerr << "failed to open \"" << path << "\" for reading" << std::endl;
+            std::exit(1);
+        }
+        while(std::getline(fh, line))
+        {
+            lines.push_back(line);
+        }
+        return lines;
+    }
+}
+
+/*
+* kept out of line: once inlined, gcc sees the malloc() and free() behind new and delete,
+* and warns about it (-Wmismatched-new-delete).
+*/
+#if defined(__GNUC__)
+    #define BENCH_NOINLINE __attribute__((noinline))
+#else
+    #define BENCH_NOINLINE
+#endif
+
+BENCH_NOINLINE void* operator new(size_t sz)
+{
+    void* ptr;
+    Bench::allocations++;
+    ptr = std::malloc((sz == 0) ? 1 : sz);
+    if(ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+BENCH_NOINLINE void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+BENCH_NOINLINE void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
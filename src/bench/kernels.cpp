@@ -0,0 +1,356 @@
+
+/*
+* microbenchmarks of the code that runs once per entry or once per line, each on its own:
+* extension/stem extraction and counting (countext), line parsing (mksum), size
+* formatting (sdu, mksum), and the dispatch of Finder's skip callbacks.
+* every kernel runs on the real path list (etc/includes.txt by default), and on
+* synthetic path sets of increasing size - the larger ones have more distinct names
+* than fit in the caches, which is where the counter tables start to hurt.
+*
+* usage: kernels [-c <file with one path per line>] [-n <count>[,<count>...]] [<filter>...]
+*   -c    the real corpus (default: etc/includes.txt)
+*   -n    sizes of the synthetic sets (default: 100000,1000000; 0 for none)
+*   only kernels whose name contains one of the <filter>s are run.
+*/
+
+#include <sstream>
+#include "shared.h"
+#include "extlist.h"
+#include "countkernels.h"
+#include "sizeparse.h"
+#include "find.hpp"
+#include "bench.h"
+#include "treegen.h"
+
+struct Corpus
+{
+    std::string name;
+    std::vector<std::string> paths;
+
+    // the same paths, as 'sdu' (and 'du -h') would print them
+    std::vector<std::string> sizelines;
+
+    // sizes to format, one per path
+    std::vector<double> sizes;
+};
+
+/* skipItem() is protected; this is how a walk gets at it, minus the walk. */
+class SkipProbe: public Find::Finder
+{
+    public:
+        using Finder::skipItem;
+};
+
+static std::vector<std::string> g_filters;
+
+static bool wanted(const std::string& name)
+{
+    if(g_filters.empty())
+    {
+        return true;
+    }
+    for(const auto& f: g_filters)
+    {
+        if(name.find(f) != std::string::npos)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename FuncT>
+static void kernel(const Corpus& corp, const std::string& name, FuncT&& fn)
+{
+    if(wanted(name))
+    {
+        Bench::print(Bench::run(name + " [" + corp.name + "]", corp.paths.size(), fn));
+    }
+}
+
+/*
+* paths that look like a source tree: a few levels of directories, names with a
+* weighted mix of extensions, some of them upper case, some without any extension,
+* and some dotfiles. the number of distinct stems grows with $count.
+*/
+static std::vector<std::string> syntheticPaths(size_t count)
+{
+    size_t i;
+    size_t j;
+    size_t depth;
+    size_t stems;
+    std::string path;
+    std::vector<std::string> paths;
+    static const char* const dirs[] = {
+        "src", "include", "lib", "test", "tests", "docs", "build", "third_party", "vendor", "tools",
+        "core", "util", "net", "io", "gfx", "audio", "platform", "linux", "win32", "internal",
+    };
+    static const char* const exts[] = {
+        ".c", ".c", ".c", ".h", ".h", ".cpp", ".cpp", ".hpp", ".o", ".txt", ".py", ".json",
+        ".md", ".tar.gz", ".so.1", ".C", ".H", ".CPP", "", "",
+    };
+    Bench::Rng rng(count);
+    // roughly one stem per four files, like foo.c/foo.h/foo.o/foo_test.c
+    stems = std::max(size_t(1), count / 4);
+    paths.reserve(count);
+    for(i=0; i<count; i++)
+    {
+        path = "./";
+        depth = rng.range(1, 6);
+        for(j=0; j<depth; j++)
+        {
+            path.append(dirs[rng.next() % Shared::arraySize(dirs)]);
+            path.push_back('/');
+        }
+        if((rng.next() % 64) == 0)
+        {
+            path.append(".hidden");
+        }
+        else
+        {
+            path.append(((rng.next() % 8) == 0) ? "Name_" : "name_");
+            path.append(std::to_string(rng.next() % stems));
+            path.append(exts[rng.next() % Shared::arraySize(exts)]);
+        }
+        paths.push_back(path);
+    }
+    return paths;
+}
+
+static void fillCorpus(Corpus& corp)
+{
+    size_t i;
+    Bench::Rng rng(42);
+    corp.sizes.reserve(corp.paths.size());
+    corp.sizelines.reserve(corp.paths.size());
+    for(i=0; i<corp.paths.size(); i++)
+    {
+        // log-uniform, up to a terabyte
+        corp.sizes.push_back(double(rng.next() % (uint64_t(1) << rng.range(1, 40))));
+        corp.sizelines.push_back(Shared::sizeToReadable(corp.sizes.back(), int(i % 3)) + "\t" + corp.paths[i]);
+    }
+}
+
+// what MkSum::processLine does per line, minus the error messages
+static int64_t processLine(std::string_view line)
+{
+    Shared::ParsedSize ps;
+    if(Shared::parseSizeLine(line, ps) == Shared::SizeParseStatus::Ok)
+    {
+        return Shared::sizeToBytes(ps);
+    }
+    return 0;
+}
+
+static void runCountKernels(const Corpus& corp)
+{
+    /*
+    * a fresh table per round would mostly measure its growth; a table that has seen
+    * every key already is what the bulk of a walk runs into.
+    */
+    Shared::ExtList extmap;
+    Shared::ExtList stemmap;
+    Shared::ExtList rawmap;
+    kernel(corp, "modeExtension", [&]
+    {
+        for(const auto& p: corp.paths)
+        {
+            Shared::countExtension(extmap, p, false, false);
+        }
+    });
+    kernel(corp, "modeExtension -c", [&]
+    {
+        for(const auto& p: corp.paths)
+        {
+            Shared::countExtension(extmap, p, true, false);
+        }
+    });
+    kernel(corp, "modeStem", [&]
+    {
+        for(const auto& p: corp.paths)
+        {
+            Shared::countStem(stemmap, p, false);
+        }
+    });
+    kernel(corp, "modeStem -c", [&]
+    {
+        for(const auto& p: corp.paths)
+        {
+            Shared::countStem(stemmap, p, true);
+        }
+    });
+    // the table alone, keyed by whole paths: as many distinct keys as there are paths
+    kernel(corp, "ExtList::increase (warm)", [&]
+    {
+        for(const auto& p: corp.paths)
+        {
+            rawmap.increase(p);
+        }
+    });
+    kernel(corp, "ExtList::increase (from empty)", [&]
+    {
+        Shared::ExtList fresh;
+        for(const auto& p: corp.paths)
+        {
+            fresh.increase(p);
+        }
+        Bench::consume(fresh.size());
+    });
+    Bench::consume(extmap.size() + stemmap.size() + rawmap.size());
+}
+
+static void runSizeKernels(const Corpus& corp)
+{
+    kernel(corp, "MkSum::processLine", [&]
+    {
+        for(const auto& line: corp.sizelines)
+        {
+            Bench::consume(size_t(processLine(line)));
+        }
+    });
+    kernel(corp, "sizeToReadable", [&]
+    {
+        for(double sz: corp.sizes)
+        {
+            Bench::consume(Shared::sizeToReadable(sz).size());
+        }
+    });
+    kernel(corp, "sizeToReadable (precision 2)", [&]
+    {
+        for(double sz: corp.sizes)
+        {
+            Bench::consume(Shared::sizeToReadable(sz, 2).size());
+        }
+    });
+}
+
+/*
+* Finder::skipItem() on entries as both kinds of backends produce them: the standard
+* backend has a std::filesystem::path already, getdents only has the bytes - and the
+* callbacks take a path, so it has to be built.
+*/
+static void runSkipKernels(const Corpus& corp)
+{
+    size_t i;
+    std::filesystem::path dir(".");
+    std::vector<std::filesystem::path> built;
+    SkipProbe none;
+    SkipProbe one;
+    SkipProbe four;
+    built.reserve(corp.paths.size());
+    for(const auto& p: corp.paths)
+    {
+        built.emplace_back(p);
+    }
+    // like countext's callback, which only looks at the flags
+    one.skipItemIf([](const std::filesystem::path&, bool isdir, bool)
+    {
+        return isdir;
+    });
+    for(i=0; i<4; i++)
+    {
+        four.skipItemIf([](const std::filesystem::path&, bool isdir, bool)
+        {
+            return isdir;
+        });
+    }
+    auto bypath = [&](SkipProbe& fi)
+    {
+        return [&built, &dir, pfi = &fi]
+        {
+            for(const auto& p: built)
+            {
+                Find::Finder::Entry ent(p, dir, 1, 0);
+                ent.isfile = true;
+                Bench::consume(pfi->skipItem(ent));
+            }
+        };
+    };
+    auto bybytes = [&](SkipProbe& fi)
+    {
+        return [&corp, &dir, pfi = &fi]
+        {
+            for(const auto& p: corp.paths)
+            {
+                Find::Finder::Entry ent(std::string_view(p), dir, 1, 0);
+                ent.isfile = true;
+                Bench::consume(pfi->skipItem(ent));
+            }
+        };
+    };
+    kernel(corp, "skipItem, 0 callbacks (path)", bypath(none));
+    kernel(corp, "skipItem, 1 callback (path)", bypath(one));
+    kernel(corp, "skipItem, 4 callbacks (path)", bypath(four));
+    kernel(corp, "skipItem, 0 callbacks (bytes)", bybytes(none));
+    kernel(corp, "skipItem, 1 callback (bytes)", bybytes(one));
+    kernel(corp, "skipItem, 4 callbacks (bytes)", bybytes(four));
+}
+
+static void runAll(Corpus& corp)
+{
+    fillCorpus(corp);
+    std::printf("corpus: %s (%zu paths)\n", corp.name.c_str(), corp.paths.size());
+    runCountKernels(corp);
+    runSizeKernels(corp);
+    runSkipKernels(corp);
+    std::printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int i;
+    size_t n;
+    std::string arg;
+    std::string item;
+    std::string corpusfile;
+    std::vector<size_t> counts;
+    corpusfile = "etc/includes.txt";
+    counts = {100 * 1000, 1000 * 1000};
+    for(i=1; i<argc; i++)
+    {
+        arg = argv[i];
+        if(((arg == "-c") || (arg == "-n")) && ((i + 1) < argc))
+        {
+            if(arg == "-c")
+            {
+                corpusfile = argv[++i];
+            }
+            else
+            {
+                counts.clear();
+                std::istringstream is(argv[++i]);
+                while(std::getline(is, item, ','))
+                {
+                    n = std::stoul(item);
+                    if(n > 0)
+                    {
+                        counts.push_back(n);
+                    }
+                }
+            }
+        }
+        else if(!arg.empty() && (arg[0] == '-'))
+        {
+            std::fprintf(stderr, "usage: %s [-c <paths file>] [-n <count>[,<count>...]] [<filter>...]\n", argv[0]);
+            return 1;
+        }
+        else
+        {
+            g_filters.push_back(arg);
+        }
+    }
+    {
+        Corpus corp;
+        corp.name = corpusfile;
+        corp.paths = Bench::readLines(corpusfile);
+        runAll(corp);
+    }
+    for(size_t count: counts)
+    {
+        Corpus corp;
+        corp.name = ("synthetic " + std::to_string(count));
+        corp.paths = syntheticPaths(count);
+        runAll(corp);
+    }
+    return 0;
+}
@@ -0,0 +1,581 @@
+/*
+* the macro benchmarks: runs countext, sdu, mksum and the Finder backends against
+* generated trees (see treegen.h), with warm and cold caches, and writes what it
+* measured as JSON - so that results of two commits can be compared
+* (see etc/benchcmp.rb).
+*
+* every run is a child process: wall time and peak RSS come from wait4(), syscalls
+* from a separate run under ptrace (which is too slow to be timed), and allocations
+* only from the walker runs, which run this very program (and its counting operator new)
+* in a special mode.
+* cold runs need to write /proc/sys/vm/drop_caches, i.e. root; they're skipped otherwise.
+*
+* usage: macro [-w<workdir>] [-o<file>] [-t<tree>]... [-r<runs>] [-C<warm|cold|both>]
+*/
+
+#include <set>
+#include <map>
+#include <unordered_map>
+#include <sstream>
+#include <algorithm>
+#include <csignal>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#include "find.hpp"
+#include "optionparser.hpp"
+#include "bench.h"
+#include "treegen.h"
+
+struct Config
+{
+    std::string workdir = "/tmp/findbench";
+    std::string output;
+    std::string bindir;
+    std::vector<std::string> trees;
+    size_t runs = 3;
+    size_t threads = std::max(2u, std::thread::hardware_concurrency());
+    bool warm = true;
+    bool cold = true;
+    bool syscalls = true;
+};
+
+/* what one job measured */
+struct Measurement
+{
+    bool ok = false;
+    std::vector<double> walls;
+    long maxrsskb = 0;
+    long long syscalls = -1;
+    long long allocations = -1;
+    size_t entries = 0;
+};
+
+struct Job
+{
+    std::string name;
+    std::vector<std::string> argv;
+    // whether this runs the walker in-process, and reports entries and allocations on stdout
+    bool walker = false;
+};
+
+struct Tree
+{
+    Bench::TreeShape shape;
+    Bench::TreeStats stats;
+    std::string root;
+    std::string listing;
+};
+
+static std::vector<Bench::TreeShape> presets()
+{
+    std::vector<Bench::TreeShape> res;
+    Bench::TreeShape sh;
+    // few, large directories
+    sh.name = "wide";
+    sh.seed = 1;
+    sh.fanout = 24;
+    sh.depth = 2;
+    sh.filesperdir = 80;
+    res.push_back(sh);
+    // narrow and deep, with long names
+    sh.name = "deep";
+    sh.seed = 2;
+    sh.fanout = 2;
+    sh.depth = 11;
+    sh.filesperdir = 10;
+    sh.minnamelen = 16;
+    sh.maxnamelen = 48;
+    res.push_back(sh);
+    // many small directories, like a source tree
+    sh = Bench::TreeShape{};
+    sh.name = "bushy";
+    sh.seed = 3;
+    sh.fanout = 8;
+    sh.depth = 4;
+    sh.filesperdir = 12;
+    res.push_back(sh);
+    return res;
+}
+
+static std::string jsonString(const std::string& str)
+{
+    char buf[8];
+    std::string res;
+    res.push_back('"');
+    for(unsigned char ch: str)
+    {
+        if((ch == '"') || (ch == '\\'))
+        {
+            res.push_back('\\');
+            res.push_back(ch);
+        }
+        else if(ch < 0x20)
+        {
+            std::snprintf(buf, sizeof(buf), "\\u%04x", ch);
+            res.append(buf);
+        }
+        else
+        {
+            res.push_back(ch);
+        }
+    }
+    res.push_back('"');
+    return res;
+}
+
+static std::string firstLineOf(const char* cmd)
+{
+    char buf[256];
+    std::string res;
+    FILE* fh;
+    fh = popen(cmd, "r");
+    if(fh == nullptr)
+    {
+        return res;
+    }
+    if(std::fgets(buf, sizeof(buf), fh) != nullptr)
+    {
+        res = buf;
+    }
+    pclose(fh);
+    while(!res.empty() && ((res.back() == '\n') || (res.back() == '\r')))
+    {
+        res.pop_back();
+    }
+    return res;
+}
+
+static bool dropCaches()
+{
+    FILE* fh;
+    sync();
+    fh = std::fopen("/proc/sys/vm/drop_caches", "w");
+    if(fh == nullptr)
+    {
+        return false;
+    }
+    std::fputs("3\n", fh);
+    return (std::fclose(fh) == 0);
+}
+
+/*
+* reuses the tree in $workdir/<name> if it was generated from the same shape,
+* and (re)generates it otherwise.
+*/
+static bool prepareTree(const std::string& workdir, Tree& tree)
+{
+    std::string line;
+    std::string sig;
+    std::filesystem::path dir;
+    dir = (std::filesystem::path(workdir) / tree.shape.name);
+    tree.root = (dir / "tree").string();
+    tree.listing = (dir / "listing.txt").string();
+    sig = tree.shape.signature();
+    {
+        std::ifstream fh((dir / "shape.txt").string());
+        if(std::getline(fh, line) && (line == sig) && (fh >> tree.stats.dirs >> tree.stats.files >> tree.stats.bytes))
+        {
+            return true;
+        }
+    }
+    std::fprintf(stderr, "generating tree '%s' ...\n", tree.shape.name.c_str());
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    Bench::TreeGenerator gen(tree.shape);
+    if(!gen.generate(tree.root, tree.listing))
+    {
+        return false;
+    }
+    tree.stats = gen.stats();
+    std::ofstream fh((dir / "shape.txt").string());
+    fh << sig << "\n" << tree.stats.dirs << " " << tree.stats.files << " " << tree.stats.bytes << "\n";
+    return fh.good();
+}
+
+/*
+* counts the syscalls made by $pid (which stopped itself right after PTRACE_TRACEME),
+* and all of its threads, until it exits.
+*/
+static long long traceSyscalls(pid_t pid)
+{
+    int st;
+    int inject;
+    pid_t tid;
+    long long count;
+    std::set<pid_t> known;
+    std::unordered_map<pid_t, bool> insyscall;
+    count = 0;
+    if((waitpid(pid, &st, __WALL) != pid) || !WIFSTOPPED(st))
+    {
+        return -1;
+    }
+    ptrace(PTRACE_SETOPTIONS, pid, 0, PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK | PTRACE_O_TRACEEXEC | PTRACE_O_EXITKILL);
+    ptrace(PTRACE_SYSCALL, pid, 0, 0);
+    known.insert(pid);
+    while((tid = waitpid(-1, &st, __WALL)) > 0)
+    {
+        if(!WIFSTOPPED(st))
+        {
+            continue;
+        }
+        inject = 0;
+        if(WSTOPSIG(st) == (SIGTRAP | 0x80))
+        {
+            // entry and exit stops alternate; only entries are counted
+            if(!insyscall[tid])
+            {
+                count++;
+            }
+            insyscall[tid] = !insyscall[tid];
+        }
+        else if((WSTOPSIG(st) == SIGTRAP) && ((st >> 16) != 0))
+        {
+            // clone/fork/exec event
+        }
+        else if((WSTOPSIG(st) == SIGSTOP) && (known.count(tid) == 0))
+        {
+            // the stop a new thread starts out with
+        }
+        else
+        {
+            inject = WSTOPSIG(st);
+        }
+        known.insert(tid);
+        ptrace(PTRACE_SYSCALL, tid, 0, inject);
+    }
+    return count;
+}
+
+/*
+* runs $job once. its stdout is collected into $output if it's a walker job,
+* and thrown away otherwise.
+*/
+static bool runOnce(const Job& job, bool traced, double& wall, long& maxrsskb, long long& syscalls, std::string& output)
+{
+    int st;
+    int devnull;
+    int pfd[2];
+    char buf[512];
+    ssize_t got;
+    pid_t pid;
+    struct rusage ru;
+    std::vector<char*> argv;
+    for(const auto& arg: job.argv)
+    {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    if(pipe(pfd) != 0)
+    {
+        return false;
+    }
+    auto started = std::chrono::steady_clock::now();
+    pid = fork();
+    if(pid == 0)
+    {
+        if(traced)
+        {
+            ptrace(PTRACE_TRACEME, 0, 0, 0);
+            raise(SIGSTOP);
+        }
+        devnull = ::open("/dev/null", O_WRONLY);
+        dup2((job.walker ? pfd[1] : devnull), 1);
+        dup2(devnull, 2);
+        ::close(pfd[0]);
+        ::close(pfd[1]);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    ::close(pfd[1]);
+    if(pid < 0)
+    {
+        ::close(pfd[0]);
+        return false;
+    }
+    if(traced)
+    {
+        syscalls = traceSyscalls(pid);
+    }
+    output.clear();
+    while((got = read(pfd[0], buf, sizeof(buf))) > 0)
+    {
+        output.append(buf, size_t(got));
+    }
+    ::close(pfd[0]);
+    if(traced)
+    {
+        // traceSyscalls() already reaped it
+        return (syscalls >= 0);
+    }
+    if(wait4(pid, &st, 0, &ru) != pid)
+    {
+        return false;
+    }
+    wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    maxrsskb = ru.ru_maxrss;
+    return (WIFEXITED(st) && (WEXITSTATUS(st) == 0));
+}
+
+static Measurement measure(const Job& job, const Tree& tree, const Config& cfg, bool cold)
+{
+    size_t i;
+    double wall;
+    long maxrss;
+    long long syscalls;
+    long long entries;
+    long long allocs;
+    std::string output;
+    Measurement m;
+    m.entries = ((tree.stats.dirs - 1) + tree.stats.files);
+    if(!cold)
+    {
+        // warm-up, not counted
+        runOnce(job, false, wall, maxrss, syscalls, output);
+    }
+    for(i=0; i<cfg.runs; i++)
+    {
+        if(cold)
+        {
+            dropCaches();
+        }
+        if(!runOnce(job, false, wall, maxrss, syscalls, output))
+        {
+            std::fprintf(stderr, "  '%s' failed\n", job.name.c_str());
+            return m;
+        }
+        m.walls.push_back(wall);
+        m.maxrsskb = std::max(m.maxrsskb, maxrss);
+        if(job.walker && (std::sscanf(output.c_str(), "%lld %lld", &entries, &allocs) == 2))
+        {
+            m.entries = size_t(entries);
+            m.allocations = allocs;
+        }
+    }
+    if(cfg.syscalls && !cold)
+    {
+        if(runOnce(job, true, wall, maxrss, syscalls, output))
+        {
+            m.syscalls = syscalls;
+        }
+    }
+    std::sort(m.walls.begin(), m.walls.end());
+    m.ok = true;
+    return m;
+}
+
+static std::vector<Job> jobsFor(const Tree& tree, const Config& cfg, const std::string& self)
+{
+    std::string nth;
+    std::vector<Job> jobs;
+    nth = std::to_string(cfg.threads);
+    auto prog = [&](const char* name)
+    {
+        return (std::filesystem::path(cfg.bindir) / name).string();
+    };
+    auto walker = [&](const std::string& backend, bool stat, const std::string& threads)
+    {
+        Job job;
+        job.name = ("walk " + backend + (stat ? " stat" : "") + ((threads != "1") ? (" -j" + threads) : ""));
+        job.argv = {self, "--walk", backend, (stat ? "1" : "0"), threads, tree.root};
+        job.walker = true;
+        jobs.push_back(job);
+    };
+    walker("std", false, "1");
+    walker("std", true, "1");
+    #if defined(__linux__)
+        walker("getdents", false, "1");
+        walker("getdents", true, "1");
+        walker("uring", true, "1");
+        walker("getdents", true, nth);
+    #endif
+    jobs.push_back(Job{"countext", {prog("countext"), tree.root}});
+    jobs.push_back(Job{"countext -j", {prog("countext"), "-j" + nth, "-Bgetdents", tree.root}});
+    jobs.push_back(Job{"sdu -r", {prog("sdu"), "-r", tree.root}});
+    jobs.push_back(Job{"sdu -r -j", {prog("sdu"), "-r", "-j" + nth, tree.root}});
+    jobs.push_back(Job{"mksum", {prog("mksum"), tree.listing}});
+    jobs.push_back(Job{"mksum -j", {prog("mksum"), "-j" + nth, tree.listing}});
+    // whatever isn't built is left out
+    jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](const Job& job)
+    {
+        return (access(job.argv[0].c_str(), X_OK) != 0);
+    }), jobs.end());
+    return jobs;
+}
+
+/*
+* what the walker jobs run: a plain walk, counting entries.
+* prints the number of entries and of allocations made during the walk.
+*/
+static int walkMode(int argc, char* argv[])
+{
+    size_t allocs;
+    Find::Finder::Backend backend;
+    std::atomic<size_t> entries(0);
+    if((argc < 6) || !Find::Finder::BackendFromString(argv[2], backend))
+    {
+        return 2;
+    }
+    Find::Finder fi(argv[5]);
+    fi.setBackend(backend);
+    fi.setWantStat(std::string(argv[3]) == "1");
+    fi.setThreads(std::stoul(argv[4]));
+    allocs = Bench::allocations.load();
+    fi.walkEntries([&](const Find::Finder::Entry& ent)
+    {
+        Bench::consume(ent.hasstat ? ent.stat.size : 0);
+        entries++;
+    });
+    allocs = (Bench::allocations.load() - allocs);
+    std::printf("%zu %zu\n", entries.load(), allocs);
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t i;
+    int cold;
+    bool first;
+    std::string self;
+    std::vector<Tree> trees;
+    std::ostringstream js;
+    struct utsname un;
+    Config cfg;
+    OptionParser prs;
+    if((argc > 1) && (std::string(argv[1]) == "--walk"))
+    {
+        return walkMode(argc, argv);
+    }
+    self = std::filesystem::read_symlink("/proc/self/exe").string();
+    // bin/bench/macro -> bin/
+    cfg.bindir = std::filesystem::path(self).parent_path().parent_path().string();
+    prs.on({"-w<dir>", "--workdir=<dir>"}, "where the trees are generated (default: /tmp/findbench)", [&](auto& v)
+    {
+        cfg.workdir = v.str();
+    });
+    prs.on({"-o<file>", "--output=<file>"}, "write the JSON results to <file> instead of stdout", [&](auto& v)
+    {
+        cfg.output = v.str();
+    });
+    prs.on({"-b<dir>", "--bindir=<dir>"}, "where countext, sdu and mksum are (default: next to bench/)", [&](auto& v)
+    {
+        cfg.bindir = v.str();
+    });
+    prs.on({"-t<name>", "--tree=<name>"}, "only use this tree (wide, deep or bushy); may be repeated", [&](auto& v)
+    {
+        cfg.trees.push_back(v.str());
+    });
+    prs.on({"-r<n>", "--runs=<n>"}, "timed runs per benchmark (default: 3)", [&](auto& v)
+    {
+        cfg.runs = std::max(1, std::stoi(v.str()));
+    });
+    prs.on({"-j<n>", "--threads=<n>"}, "threads for the parallel runs (default: one per core, at least 2)", [&](auto& v)
+    {
+        cfg.threads = std::max(1, std::stoi(v.str()));
+    });
+    prs.on({"-C<mode>", "--cache=<mode>"}, "'warm', 'cold' or 'both' (default)", [&](auto& v)
+    {
+        cfg.warm = (v.str() != "cold");
+        cfg.cold = (v.str() != "warm");
+    });
+    prs.on({"-n", "--no-syscalls"}, "don't count syscalls (which takes an extra, traced run)", [&]
+    {
+        cfg.syscalls = false;
+    });
+    try
+    {
+        prs.parse(argc, argv);
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 1;
+    }
+    for(const auto& shape: presets())
+    {
+        if(cfg.trees.empty() || (std::find(cfg.trees.begin(), cfg.trees.end(), shape.name) != cfg.trees.end()))
+        {
+            trees.push_back(Tree{shape, {}, {}, {}});
+            if(!prepareTree(cfg.workdir, trees.back()))
+            {
+                std::cerr << "failed to generate tree '" << shape.name << "' in " << cfg.workdir << std::endl;
+                return 1;
+            }
+        }
+    }
+    if(trees.empty())
+    {
+        std::cerr << "no such tree" << std::endl;
+        return 1;
+    }
+    if(cfg.cold && !dropCaches())
+    {
+        std::cerr << "note: can't drop the page cache (not root?) - skipping cold runs" << std::endl;
+        cfg.cold = false;
+    }
+    uname(&un);
+    js << "{\n";
+    js << "  \"version\": 1,\n";
+    js << "  \"commit\": " << jsonString(firstLineOf("git rev-parse HEAD 2>/dev/null")) << ",\n";
+    js << "  \"host\": {\"system\": " << jsonString(std::string(un.sysname) + " " + un.release) << ", \"cpus\": "
+       << std::thread::hardware_concurrency() << ", \"compiler\": " << jsonString(__VERSION__) << "},\n";
+    js << "  \"runs\": " << cfg.runs << ",\n";
+    js << "  \"threads\": " << cfg.threads << ",\n";
+    js << "  \"trees\": [\n";
+    for(i=0; i<trees.size(); i++)
+    {
+        const auto& t = trees[i];
+        js << "    {\"name\": " << jsonString(t.shape.name) << ", \"shape\": " << jsonString(t.shape.signature())
+           << ", \"dirs\": " << t.stats.dirs << ", \"files\": " << t.stats.files << ", \"bytes\": " << t.stats.bytes << "}"
+           << (((i + 1) < trees.size()) ? ",\n" : "\n");
+    }
+    js << "  ],\n";
+    js << "  \"results\": [\n";
+    first = true;
+    for(const auto& tree: trees)
+    {
+        for(const auto& job: jobsFor(tree, cfg, self))
+        {
+            for(cold=0; cold<2; cold++)
+            {
+                if(!(cold ? cfg.cold : cfg.warm))
+                {
+                    continue;
+                }
+                std::fprintf(stderr, "%s: %s (%s)\n", tree.shape.name.c_str(), job.name.c_str(), (cold ? "cold" : "warm"));
+                auto m = measure(job, tree, cfg, cold);
+                if(!m.ok)
+                {
+                    continue;
+                }
+                js << (first ? "" : ",\n");
+                first = false;
+                js << "    {\"tree\": " << jsonString(tree.shape.name) << ", \"bench\": " << jsonString(job.name)
+                   << ", \"cache\": " << jsonString(cold ? "cold" : "warm")
+                   << ", \"wall_s\": " << m.walls.front() << ", \"wall_median_s\": " << m.walls[m.walls.size() / 2]
+                   << ", \"entries\": " << m.entries << ", \"entries_per_s\": " << (double(m.entries) / m.walls.front())
+                   << ", \"peak_rss_kb\": " << m.maxrsskb
+                   << ", \"syscalls\": " << ((m.syscalls >= 0) ? std::to_string(m.syscalls) : "null")
+                   << ", \"allocations\": " << ((m.allocations >= 0) ? std::to_string(m.allocations) : "null") << "}";
+            }
+        }
+    }
+    js << "\n  ]\n";
+    js << "}\n";
+    if(cfg.output.empty())
+    {
+        std::fputs(js.str().c_str(), stdout);
+    }
+    else
+    {
+        std::ofstream fh(cfg.output, std::ios::out | std::ios::binary);
+        fh << js.str();
+        if(!fh.good())
+        {
+            std::cerr << "failed to write \"" << cfg.output << "\"" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,121 @@
+
+/*
+* compares mksum's old line parser (std::isdigit, substr, std::stod and a std::map
+* lookup per line) with what mksum runs now: Shared::parseSizeLine() and Shared::sizeToBytes().
+* usage: mksumparse [<du -h style output>] (default: a synthetic set of 1M lines)
+*/
+
+#include <map>
+#include <random>
+#include "shared.h"
+#include "sizeparse.h"
+#include "bench.h"
+
+static const auto UNITS = std::map<char, int64_t>{
+    {'B', 1},
+    {'K', 1024},
+    {'M', 1048576},
+    {'G', 1073741824},
+    {'T', 1099511627776},
+    {'P', 1125899906842624},
+    {'E', 1152921504606846976},
+};
+
+// MkSum::processLine as it was, minus the error messages
+static int64_t oldProcessLine(const std::string& line)
+{
+    int ch;
+    size_t ofs;
+    size_t efs;
+    std::string nstr;
+    ofs = 0;
+    while(std::isspace(line[ofs]))
+    {
+        ofs++;
+    }
+    if(ofs < line.length())
+    {
+        efs = 0;
+        while(std::isdigit(line[ofs + efs]) || (line[ofs + efs] == '.'))
+        {
+            efs++;
+        }
+        if(efs != ofs)
+        {
+            ch = std::toupper(line[efs]);
+            nstr = line.substr(ofs, efs);
+            auto unit = UNITS.find(ch);
+            if(unit != UNITS.end())
+            {
+                return (std::stod(nstr) * unit->second);
+            }
+        }
+    }
+    return 0;
+}
+
+static int64_t newProcessLine(std::string_view line)
+{
+    Shared::ParsedSize ps;
+    if(Shared::parseSizeLine(line, ps) == Shared::SizeParseStatus::Ok)
+    {
+        return Shared::sizeToBytes(ps);
+    }
+    return 0;
+}
+
+// lines like the ones 'sdu' and 'du -h' print
+static std::vector<std::string> syntheticLines(size_t count)
+{
+    size_t i;
+    std::mt19937_64 rng(42);
+    std::vector<std::string> lines;
+    lines.reserve(count);
+    for(i=0; i<count; i++)
+    {
+        lines.push_back(Shared::sizeToReadable(double(rng() % (1ull << 40)), int(i % 3)) + "\t./some/directory/file" + std::to_string(i));
+    }
+    return lines;
+}
+
+int main(int argc, char* argv[])
+{
+    int64_t oldsum;
+    int64_t newsum;
+    std::vector<std::string> lines;
+    if(argc > 1)
+    {
+        lines = Bench::readLines(argv[1]);
+    }
+    else
+    {
+        lines = syntheticLines(1000 * 1000);
+    }
+    std::printf("corpus: %zu lines\n", lines.size());
+    oldsum = 0;
+    newsum = 0;
+    for(const auto& line: lines)
+    {
+        oldsum += oldProcessLine(line);
+        newsum += newProcessLine(line);
+    }
+    if(oldsum != newsum)
+    {
+        std::printf("warning: parsers disagree (old: %lld, new: %lld)\n", (long long)oldsum, (long long)newsum);
+    }
+    Bench::print(Bench::run("processLine (std::stod + std::map)", lines.size(), [&]
+    {
+        for(const auto& line: lines)
+        {
+            Bench::consume(oldProcessLine(line));
+        }
+    }));
+    Bench::print(Bench::run("parseSizeLine + sizeToBytes", lines.size(), [&]
+    {
+        for(const auto& line: lines)
+        {
+            Bench::consume(newProcessLine(line));
+        }
+    }));
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+* compares matching paths against a set of prune rules the way countext used
+* to - one std::function per rule, each building a std::filesystem::path - with
+* a compiled Find::NameRules.
+* usage: namerules [<file with one path per line>] (default: etc/includes.txt)
+*/
+
+#include <functional>
+#include "find.hpp"
+#include "findrules.hpp"
+#include "bench.h"
+
+static const char* const rules[] =
+{
+    "node_modules", ".git", ".svn", "build", "CMakeFiles", "__pycache__",
+    "*.o", "*.obj", "*.pyc", "*.tmp", "*~", "#*#", "*.sw?", "lib*.a",
+    "src/vendor", "third_party/*/test",
+};
+
+int main(int argc, char* argv[])
+{
+    std::string corpus;
+    std::vector<std::string> lines;
+    std::vector<std::function<bool(const std::filesystem::path&)>> chain;
+    Find::NameRules compiled;
+    corpus = ((argc > 1) ? argv[1] : "etc/includes.txt");
+    lines = Bench::readLines(corpus);
+    std::printf("corpus: %s (%zu paths, %zu rules)\n", corpus.c_str(), lines.size(), std::size(rules));
+    for(const char* rule: rules)
+    {
+        compiled.add(rule);
+        // roughly what a hand-written pruneIf() lambda per rule does
+        chain.push_back([pat = Find::GlobPattern(rule)](const std::filesystem::path& p)
+        {
+            return pat.match(p.filename().string());
+        });
+    }
+    Bench::print(Bench::run("std::function chain", lines.size(), [&]
+    {
+        size_t hits;
+        hits = 0;
+        for(const auto& line: lines)
+        {
+            std::filesystem::path p(line);
+            for(const auto& fn: chain)
+            {
+                if(fn(p))
+                {
+                    hits++;
+                    break;
+                }
+            }
+        }
+        Bench::consume(hits);
+    }));
+    Bench::print(Bench::run("NameRules", lines.size(), [&]
+    {
+        size_t hits;
+        hits = 0;
+        for(const auto& line: lines)
+        {
+            hits += (compiled.match(line) ? 1 : 0);
+        }
+        Bench::consume(hits);
+    }));
+    return 0;
+}
@@ -0,0 +1,99 @@
+
+/*
+* compares how countext used to extract extensions and stems - through
+* std::filesystem::path, and a lowercased std::string copy - with the
+* string_view slicing it does now.
+* usage: namesplit [<file with one path per line>] (default: etc/includes.txt)
+*/
+
+#include <algorithm>
+#include "shared.h"
+#include "find.hpp"
+#include "bench.h"
+
+// what CountFiles::modeExtension + increase did before, with '-c'
+static size_t oldExtension(const std::string& line)
+{
+    std::string strext;
+    std::string bnamestr;
+    std::string copy;
+    std::filesystem::path item(line);
+    std::filesystem::path bname;
+    bname = item.filename();
+    bnamestr = bname.string();
+    if(bnamestr.empty())
+    {
+        return 0;
+    }
+    strext = bname.extension().string();
+    copy = ((strext.size() > 1) ? strext : bname.string());
+    std::transform(copy.begin(), copy.end(), copy.begin(), ::tolower);
+    return copy.size();
+}
+
+static size_t oldStem(const std::string& line)
+{
+    std::string copy;
+    std::filesystem::path item(line);
+    copy = item.stem().string();
+    std::transform(copy.begin(), copy.end(), copy.begin(), ::tolower);
+    return copy.size();
+}
+
+static size_t newExtension(std::string_view line)
+{
+    char buf[256];
+    std::string_view bname;
+    std::string_view ext;
+    bname = Shared::pathFilename(line);
+    if(bname.empty())
+    {
+        return 0;
+    }
+    ext = Shared::pathExtension(bname);
+    return Shared::asciiLower(((ext.size() > 1) ? ext : bname).substr(0, sizeof(buf)), buf).size();
+}
+
+static size_t newStem(std::string_view line)
+{
+    char buf[256];
+    return Shared::asciiLower(Shared::pathStem(line).substr(0, sizeof(buf)), buf).size();
+}
+
+int main(int argc, char* argv[])
+{
+    std::string corpus;
+    std::vector<std::string> lines;
+    corpus = ((argc > 1) ? argv[1] : "etc/includes.txt");
+    lines = Bench::readLines(corpus);
+    std::printf("corpus: %s (%zu paths)\n", corpus.c_str(), lines.size());
+    Bench::print(Bench::run("extension (std::filesystem::path)", lines.size(), [&]
+    {
+        for(const auto& line: lines)
+        {
+            Bench::consume(oldExtension(line));
+        }
+    }));
+    Bench::print(Bench::run("extension (string_view)", lines.size(), [&]
+    {
+        for(const auto& line: lines)
+        {
+            Bench::consume(newExtension(line));
+        }
+    }));
+    Bench::print(Bench::run("stem (std::filesystem::path)", lines.size(), [&]
+    {
+        for(const auto& line: lines)
+        {
+            Bench::consume(oldStem(line));
+        }
+    }));
+    Bench::print(Bench::run("stem (string_view)", lines.size(), [&]
+    {
+        for(const auto& line: lines)
+        {
+            Bench::consume(newStem(line));
+        }
+    }));
+    return 0;
+}
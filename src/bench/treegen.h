@@ -0,0 +1,246 @@
+
+/*
+* generates directory trees of a given shape, for the macro benchmarks.
+* everything is derived from the shape and its seed with a PRNG of our own (the
+* distributions in <random> differ between standard libraries), so the same shape
+* gives the same tree - names, extensions, sizes - on every machine and every commit.
+* files are sparse (made with ftruncate), so a large tree costs inodes, not disk space.
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace Bench
+{
+    /* splitmix64: tiny, fast, and fully specified */
+    class Rng
+    {
+        private:
+            uint64_t m_state;
+
+        public:
+            Rng(uint64_t seed): m_state(seed)
+            {
+            }
+
+            uint64_t next()
+            {
+                uint64_t z;
+                z = (m_state += 0x9e3779b97f4a7c15ull);
+                z = ((z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull);
+                z = ((z ^ (z >> 27)) * 0x94d049bb133111ebull);
+                return (z ^ (z >> 31));
+            }
+
+            // in [lo, hi]
+            uint64_t range(uint64_t lo, uint64_t hi)
+            {
+                return (lo + (next() % ((hi - lo) + 1)));
+            }
+    };
+
+    struct Extension
+    {
+        std::string ext;
+        unsigned weight;
+    };
+
+    struct TreeShape
+    {
+        std::string name;
+        uint64_t seed = 1;
+
+        // subdirectories per directory, and how many levels of them
+        size_t fanout = 4;
+        size_t depth = 3;
+
+        size_t filesperdir = 20;
+
+        // names are drawn uniformly from this many characters (not counting the extension)
+        size_t minnamelen = 4;
+        size_t maxnamelen = 16;
+
+        // sizes are log-uniform between 0 and 2^maxsizebits bytes
+        size_t maxsizebits = 20;
+
+        // what files end in, and how often ("" being no extension at all)
+        std::vector<Extension> exts = {
+            {".c", 20}, {".h", 15}, {".cpp", 10}, {".o", 10}, {".txt", 8}, {".py", 6},
+            {".json", 5}, {".md", 3}, {".tar.gz", 2}, {".so.1", 1}, {"", 10},
+        };
+
+        // everything that affects the generated tree, as a line of text
+        std::string signature() const
+        {
+            std::ostringstream os;
+            os << "treegen/1 seed=" << seed << " fanout=" << fanout << " depth=" << depth
+               << " files=" << filesperdir << " names=" << minnamelen << "-" << maxnamelen
+               << " sizebits=" << maxsizebits << " exts=";
+            for(const auto& e: exts)
+            {
+                os << "[" << e.ext << "]" << e.weight;
+            }
+            return os.str();
+        }
+    };
+
+    struct TreeStats
+    {
+        size_t dirs = 0;
+        size_t files = 0;
+        uint64_t bytes = 0;
+    };
+
+    class TreeGenerator
+    {
+        private:
+            const TreeShape& m_shape;
+            Rng m_rng;
+            unsigned m_totalweight = 0;
+            size_t m_serial = 0;
+            TreeStats m_stats;
+            std::ofstream m_listing;
+
+        private:
+            /*
+            * a random name, made unique by a serial number - so the tree never depends
+            * on whether two random names happened to collide.
+            */
+            std::string makeName(char kind)
+            {
+                size_t i;
+                size_t len;
+                std::string name;
+                static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789_-";
+                len = m_rng.range(m_shape.minnamelen, m_shape.maxnamelen);
+                name.push_back(kind);
+                for(i=1; i<len; i++)
+                {
+                    name.push_back(chars[m_rng.next() % (sizeof(chars) - 1)]);
+                }
+                name.append(std::to_string(m_serial++));
+                return name;
+            }
+
+            const std::string& pickExtension()
+            {
+                uint64_t pick;
+                pick = (m_rng.next() % m_totalweight);
+                for(const auto& e: m_shape.exts)
+                {
+                    if(pick < e.weight)
+                    {
+                        return e.ext;
+                    }
+                    pick -= e.weight;
+                }
+                return m_shape.exts.back().ext;
+            }
+
+            uint64_t pickSize()
+            {
+                uint64_t bits;
+                bits = m_rng.range(0, m_shape.maxsizebits);
+                if(bits == 0)
+                {
+                    return 0;
+                }
+                return ((uint64_t(1) << (bits - 1)) + (m_rng.next() % (uint64_t(1) << (bits - 1))));
+            }
+
+            bool makeFile(const std::string& path, uint64_t size)
+            {
+                int fd;
+                bool ok;
+                fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if(fd == -1)
+                {
+                    return false;
+                }
+                ok = (ftruncate(fd, off_t(size)) == 0);
+                ::close(fd);
+                return ok;
+            }
+
+            bool fill(const std::string& dir, size_t level)
+            {
+                size_t i;
+                uint64_t size;
+                std::string path;
+                m_stats.dirs++;
+                for(i=0; i<m_shape.filesperdir; i++)
+                {
+                    path = dir + "/" + makeName('f') + pickExtension();
+                    size = pickSize();
+                    if(!makeFile(path, size))
+                    {
+                        std::perror(path.c_str());
+                        return false;
+                    }
+                    m_stats.files++;
+                    m_stats.bytes += size;
+                    // what mksum reads: a size with a unit (here, always bytes), and the path
+                    m_listing << size << "B\t" << path << "\n";
+                }
+                if(level >= m_shape.depth)
+                {
+                    return true;
+                }
+                for(i=0; i<m_shape.fanout; i++)
+                {
+                    path = dir + "/" + makeName('d');
+                    if(::mkdir(path.c_str(), 0755) != 0)
+                    {
+                        std::perror(path.c_str());
+                        return false;
+                    }
+                    if(!fill(path, level + 1))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+        public:
+            TreeGenerator(const TreeShape& shape): m_shape(shape), m_rng(shape.seed)
+            {
+                for(const auto& e: m_shape.exts)
+                {
+                    m_totalweight += e.weight;
+                }
+            }
+
+            /*
+            * creates the tree in $root (which must not exist yet), and writes a line
+            * per file into $listing.
+            */
+            bool generate(const std::string& root, const std::string& listing)
+            {
+                m_listing.open(listing, std::ios::out | std::ios::binary);
+                if(!m_listing.good() || (m_totalweight == 0))
+                {
+                    return false;
+                }
+                if(::mkdir(root.c_str(), 0755) != 0)
+                {
+                    std::perror(root.c_str());
+                    return false;
+                }
+                return fill(root, 0);
+            }
+
+            const TreeStats& stats() const
+            {
+                return m_stats;
+            }
+    };
+}
@@ -0,0 +1,89 @@
+
+#pragma once
+#include <string>
+#include <string_view>
+#include "shared.h"
+#include "extlist.h"
+
+namespace Shared
+{
+    /*
+    * what countext does once per item, shared with the kernels benchmark so that
+    * it measures exactly this code.
+    * every count*() function returns the key it counted (as found in $item, i.e.
+    * before lowercasing), or an empty string_view if it counted nothing.
+    */
+
+    /*
+    * counts $val in $map, lowercased first if $icase.
+    * $val is a slice of a path, so it mustn't be modified in place: lowercasing
+    * goes through a stack buffer instead (filenames are at most 255 bytes on
+    * pretty much every filesystem; anything longer takes the slow path).
+    */
+    inline std::string_view countKey(ExtList& map, std::string_view val, bool icase)
+    {
+        char stackbuf[256];
+        std::string heapbuf;
+        char* dest;
+        if(icase)
+        {
+            dest = stackbuf;
+            if(val.size() > sizeof(stackbuf))
+            {
+                heapbuf.resize(val.size());
+                dest = &heapbuf[0];
+            }
+            map.increase(asciiLower(val, dest));
+        }
+        else
+        {
+            map.increase(val);
+        }
+        return val;
+    }
+
+    /*
+    * counts the extension of $item - or, if it has none, its whole filename, unless
+    * $reject_noext is set.
+    */
+    inline std::string_view countExtension(ExtList& map, std::string_view item, bool icase, bool reject_noext)
+    {
+        std::string_view strext;
+        std::string_view bnamestr;
+        bnamestr = pathFilename(item);
+        /*
+        * if the item path is something like "foo/bar/", then
+        * bname is just an empty string, and doesn't contain anything to work with.
+        * theoretically, this shouldn't happen, though.
+        */
+        if(bnamestr.empty())
+        {
+            return {};
+        }
+        strext = pathExtension(bnamestr);
+        /*
+        * in some super funky cases, the extension might be something
+        * like "." (i.e., "foo."). i don't who or why someone would
+        * name a file like this, but still.
+        */
+        if(strext.size() > 1)
+        {
+            return countKey(map, strext, icase);
+        }
+        if(reject_noext)
+        {
+            return {};
+        }
+        return countKey(map, bnamestr, icase);
+    }
+
+    inline std::string_view countStem(ExtList& map, std::string_view item, bool icase)
+    {
+        return countKey(map, pathStem(item), icase);
+    }
+
+    inline std::string_view countFilename(ExtList& map, std::string_view item, bool icase)
+    {
+        return countKey(map, pathFilename(item), icase);
+    }
+}
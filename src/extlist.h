@@ -0,0 +1,190 @@
+
+#pragma once
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+
+namespace Shared
+{
+    /*
+    * a counter table, keyed by extension (or stem, or filename).
+    * the keys are kept in an arena, and looked up through an open-addressing hash table
+    * (linear probing, kept at most half full), so counting is O(1) per file, and
+    * looking up a key that has been seen before doesn't allocate anything.
+    * items keep the order they were first seen in, until sort() is called.
+    */
+    class ExtList
+    {
+        public:
+            template<typename T>
+            using ContainerType = std::vector<T>;
+
+            struct Item
+            {
+                // points into the arena of the ExtList it came from
+                std::string_view ext;
+                size_t count;
+                size_t hash;
+            };
+
+        private:
+            // size of each arena block. keys longer than this get a block of their own
+            static constexpr size_t ArenaBlockSize = (1024 * 64);
+
+            // each slot is an index into m_items plus one; zero marks an empty slot
+            ContainerType<size_t> m_slots;
+            ContainerType<Item> m_items;
+            ContainerType<std::unique_ptr<char[]>> m_arena;
+            size_t m_arenaused = ArenaBlockSize;
+            std::hash<std::string_view> m_hashfn;
+
+        private:
+            std::string_view store(std::string_view key)
+            {
+                char* dest;
+                /* nothing to copy (e.g., the stem of a dotfile), and maybe no block to copy it to yet */
+                if(key.empty())
+                {
+                    return std::string_view();
+                }
+                if(key.size() > ArenaBlockSize)
+                {
+                    /* goes in front of the current block, which keeps being filled */
+                    auto pos = m_arena.insert(m_arena.end() - (m_arena.empty() ? 0 : 1), std::unique_ptr<char[]>(new char[key.size()]));
+                    dest = pos->get();
+                }
+                else
+                {
+                    if((m_arenaused + key.size()) > ArenaBlockSize)
+                    {
+                        m_arena.emplace_back(new char[ArenaBlockSize]);
+                        m_arenaused = 0;
+                    }
+                    dest = m_arena.back().get() + m_arenaused;
+                    m_arenaused += key.size();
+                }
+                std::memcpy(dest, key.data(), key.size());
+                return std::string_view(dest, key.size());
+            }
+
+            void insertSlot(size_t hash, size_t idx)
+            {
+                size_t mask;
+                size_t pos;
+                mask = (m_slots.size() - 1);
+                pos = (hash & mask);
+                while(m_slots[pos] != 0)
+                {
+                    pos = ((pos + 1) & mask);
+                }
+                m_slots[pos] = (idx + 1);
+            }
+
+            void rehash(size_t newsize)
+            {
+                size_t i;
+                m_slots.assign(newsize, 0);
+                for(i=0; i<m_items.size(); i++)
+                {
+                    insertSlot(m_items[i].hash, i);
+                }
+            }
+
+        public:
+            ExtList()
+            {
+                rehash(1024);
+            }
+
+            ExtList(const ExtList&) = delete;
+            ExtList& operator=(const ExtList&) = delete;
+
+            auto begin()
+            {
+                return m_items.begin();
+            }
+
+            auto end()
+            {
+                return m_items.end();
+            }
+
+            auto rbegin()
+            {
+                return m_items.rbegin();
+            }
+
+            auto rend()
+            {
+                return m_items.rend();
+            }
+
+            size_t size() const
+            {
+                return m_items.size();
+            }
+
+            void increase(std::string_view ext)
+            {
+                add(ext, m_hashfn(ext), 1);
+            }
+
+            void add(std::string_view ext, size_t hash, size_t count)
+            {
+                size_t mask;
+                size_t pos;
+                size_t slot;
+                mask = (m_slots.size() - 1);
+                pos = (hash & mask);
+                while((slot = m_slots[pos]) != 0)
+                {
+                    auto& item = m_items[slot - 1];
+                    /*
+                    * comparing the hash first skips most of the string compares,
+                    * but only the key itself decides - different keys may well share a hash.
+                    */
+                    if((item.hash == hash) && (item.ext == ext))
+                    {
+                        item.count += count;
+                        return;
+                    }
+                    pos = ((pos + 1) & mask);
+                }
+                m_items.push_back(Item{store(ext), count, hash});
+                if((m_items.size() * 2) > m_slots.size())
+                {
+                    rehash(m_slots.size() * 2);
+                }
+                else
+                {
+                    m_slots[pos] = m_items.size();
+                }
+            }
+
+            /*
+            * adds the counts of $other to this list. keys that are new to this list
+            * are appended in the order $other has them.
+            */
+            void merge(ExtList& other)
+            {
+                for(const auto& item: other.m_items)
+                {
+                    add(item.ext, item.hash, item.count);
+                }
+            }
+
+            /*
+            * sorts the items, and rebuilds the table to match their new positions.
+            */
+            template<typename CompareT>
+            void sort(CompareT&& cmp)
+            {
+                std::sort(m_items.begin(), m_items.end(), cmp);
+                rehash(m_slots.size());
+            }
+    };
+}
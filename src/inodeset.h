@@ -0,0 +1,133 @@
+
+#pragma once
+#include <vector>
+#include <array>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+namespace Shared
+{
+    /*
+    * a set of (device, inode) pairs, for counting hard-linked files only once.
+    * the set is split into shards, each with its own lock, so threads rarely wait on
+    * each other; within a shard, pairs are stored inline in an open-addressed table
+    * (16 bytes per pair, no allocation per insert), which doubles once it's half full.
+    */
+    class InodeSet
+    {
+        private:
+            static constexpr size_t ShardCount = 64;
+            static constexpr size_t InitialSlots = 64;
+
+            struct Key
+            {
+                uint64_t dev;
+                uint64_t ino;
+            };
+
+            // no file has this device and inode number, so it marks free slots
+            static constexpr Key Empty = {~uint64_t(0), ~uint64_t(0)};
+
+            // aligned, so that two shards' locks never share a cache line
+            struct alignas(64) Shard
+            {
+                std::mutex mutex;
+                std::vector<Key> slots;
+                size_t count = 0;
+            };
+
+        private:
+            std::array<Shard, ShardCount> m_shards;
+
+        private:
+            static uint64_t hashOf(uint64_t dev, uint64_t ino)
+            {
+                // splitmix64's finalizer: inode numbers are mostly sequential, this spreads them out
+                uint64_t h;
+                h = (ino ^ (dev * 0x9e3779b97f4a7c15ull));
+                h = ((h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull);
+                h = ((h ^ (h >> 27)) * 0x94d049bb133111ebull);
+                return (h ^ (h >> 31));
+            }
+
+            static bool isEmpty(const Key& k)
+            {
+                return ((k.dev == Empty.dev) && (k.ino == Empty.ino));
+            }
+
+            // returns false if it was already there
+            static bool place(std::vector<Key>& slots, const Key& key, uint64_t hash)
+            {
+                size_t mask;
+                size_t i;
+                mask = (slots.size() - 1);
+                // the low bits picked the shard, so start from the high ones
+                for(i=((hash >> 32) & mask); !isEmpty(slots[i]); i=((i + 1) & mask))
+                {
+                    if((slots[i].dev == key.dev) && (slots[i].ino == key.ino))
+                    {
+                        return false;
+                    }
+                }
+                slots[i] = key;
+                return true;
+            }
+
+            static void grow(Shard& sh)
+            {
+                std::vector<Key> bigger(std::max(InitialSlots, sh.slots.size() * 2), Empty);
+                for(const auto& k: sh.slots)
+                {
+                    if(!isEmpty(k))
+                    {
+                        place(bigger, k, hashOf(k.dev, k.ino));
+                    }
+                }
+                sh.slots.swap(bigger);
+            }
+
+        public:
+            InodeSet()
+            {
+            }
+
+            InodeSet(const InodeSet&) = delete;
+            InodeSet& operator=(const InodeSet&) = delete;
+
+            /*
+            * adds the pair, and returns true if it wasn't in the set yet - i.e.,
+            * if this is the first time the file is seen.
+            * safe to call from any number of threads at once.
+            */
+            bool insert(uint64_t dev, uint64_t ino)
+            {
+                uint64_t hash;
+                hash = hashOf(dev, ino);
+                auto& sh = m_shards[hash % ShardCount];
+                std::lock_guard<std::mutex> lock(sh.mutex);
+                if((sh.count + 1) * 2 > sh.slots.size())
+                {
+                    grow(sh);
+                }
+                if(!place(sh.slots, Key{dev, ino}, hash))
+                {
+                    return false;
+                }
+                sh.count++;
+                return true;
+            }
+
+            size_t size()
+            {
+                size_t n;
+                n = 0;
+                for(auto& sh: m_shards)
+                {
+                    std::lock_guard<std::mutex> lock(sh.mutex);
+                    n += sh.count;
+                }
+                return n;
+            }
+    };
+}
@@ -0,0 +1,109 @@
+
+#pragma once
+#include <string_view>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+namespace Shared
+{
+    /*
+    * reads lines (or NUL-terminated records, as written by 'find -print0') from a FILE*,
+    * in large blocks, and hands them out as string_views into its buffer.
+    * each view stays valid until the next call to next().
+    *
+    * compared to std::getline(), this does no per-character work at all: the
+    * separator is found with memchr(), which libc implements with SIMD instructions.
+    */
+    class LineReader
+    {
+        public:
+            static constexpr size_t DefaultBlockSize = (1024 * 1024 * 2);
+
+        private:
+            FILE* m_handle;
+            char m_delim;
+            bool m_eof = false;
+            std::vector<char> m_buffer;
+            size_t m_begin = 0;
+            size_t m_end = 0;
+
+        private:
+            /*
+            * moves the incomplete line at the end of the buffer to its front, and
+            * reads the next block behind it. a line that is longer than the entire buffer
+            * makes the buffer grow.
+            */
+            void refill()
+            {
+                size_t rest;
+                size_t got;
+                rest = (m_end - m_begin);
+                if((rest > 0) && (m_begin > 0))
+                {
+                    std::memmove(m_buffer.data(), m_buffer.data() + m_begin, rest);
+                }
+                m_begin = 0;
+                m_end = rest;
+                if(m_end == m_buffer.size())
+                {
+                    m_buffer.resize(m_buffer.size() * 2);
+                }
+                got = std::fread(m_buffer.data() + m_end, 1, m_buffer.size() - m_end, m_handle);
+                if(got == 0)
+                {
+                    m_eof = true;
+                }
+                m_end += got;
+            }
+
+            std::string_view finish(size_t from, size_t to)
+            {
+                // '\r\n' line endings, as produced by pretty much anything on windows
+                if((m_delim == '\n') && (to > from) && (m_buffer[to - 1] == '\r'))
+                {
+                    to--;
+                }
+                return std::string_view(m_buffer.data() + from, to - from);
+            }
+
+        public:
+            LineReader(FILE* fh, char delim='\n', size_t blocksize=DefaultBlockSize): m_handle(fh), m_delim(delim), m_buffer(blocksize)
+            {
+            }
+
+            bool next(std::string_view& line)
+            {
+                size_t from;
+                const char* found;
+                while(true)
+                {
+                    found = nullptr;
+                    if(m_end > m_begin)
+                    {
+                        found = static_cast<const char*>(std::memchr(m_buffer.data() + m_begin, m_delim, m_end - m_begin));
+                    }
+                    if(found != nullptr)
+                    {
+                        from = m_begin;
+                        m_begin = ((found - m_buffer.data()) + 1);
+                        line = finish(from, m_begin - 1);
+                        return true;
+                    }
+                    if(m_eof)
+                    {
+                        // the last line need not be terminated
+                        if(m_end > m_begin)
+                        {
+                            from = m_begin;
+                            m_begin = m_end;
+                            line = finish(from, m_end);
+                            return true;
+                        }
+                        return false;
+                    }
+                    refill();
+                }
+            }
+    };
+}
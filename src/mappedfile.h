@@ -0,0 +1,167 @@
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <cstring>
+
+#if defined(__unix__) || defined(__linux__) || defined(__APPLE__)
+    #include <sys/types.h>
+    #include <sys/stat.h>
+    #include <sys/mman.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #define SHARED_HAVE_MMAP
+#endif
+
+namespace Shared
+{
+    /*
+    * a read-only view of an entire file.
+    * on unixlike platforms, the file is mmap()'d, with a hint that it'll be read
+    * front to back, so the kernel reads ahead aggressively and drops pages behind
+    * the reader. elsewhere - or if the file can't be mapped, like a pipe - the
+    * contents are read into memory instead.
+    */
+    class MappedFile
+    {
+        private:
+            const char* m_data = nullptr;
+            size_t m_size = 0;
+            bool m_mapped = false;
+            std::vector<char> m_fallback;
+
+        private:
+            bool readFallback(const std::string& path)
+            {
+                std::ifstream fh(path, std::ios::in | std::ios::binary);
+                if(!fh.good())
+                {
+                    return false;
+                }
+                m_fallback.assign(std::istreambuf_iterator<char>(fh), std::istreambuf_iterator<char>());
+                m_data = m_fallback.data();
+                m_size = m_fallback.size();
+                return true;
+            }
+
+        public:
+            MappedFile()
+            {
+            }
+
+            ~MappedFile()
+            {
+                #if defined(SHARED_HAVE_MMAP)
+                    if(m_mapped)
+                    {
+                        munmap(const_cast<char*>(m_data), m_size);
+                    }
+                #endif
+            }
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            bool open(const std::string& path)
+            {
+                #if defined(SHARED_HAVE_MMAP)
+                    int fd;
+                    void* addr;
+                    struct stat st;
+                    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+                    if(fd == -1)
+                    {
+                        return false;
+                    }
+                    if((fstat(fd, &st) == 0) && S_ISREG(st.st_mode))
+                    {
+                        // mapping zero bytes fails, but there's nothing to read anyway
+                        if(st.st_size == 0)
+                        {
+                            ::close(fd);
+                            return true;
+                        }
+                        addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                        if(addr != MAP_FAILED)
+                        {
+                            ::close(fd);
+                            madvise(addr, st.st_size, MADV_SEQUENTIAL);
+                            m_data = static_cast<const char*>(addr);
+                            m_size = st.st_size;
+                            m_mapped = true;
+                            return true;
+                        }
+                    }
+                    ::close(fd);
+                #endif
+                return readFallback(path);
+            }
+
+            std::string_view view() const
+            {
+                return std::string_view(m_data, m_size);
+            }
+    };
+
+    /*
+    * splits $data into (at most) $count pieces of about the same size, each of
+    * which ends right after a $delim (or at the end of $data), so that no line is
+    * ever split between two pieces.
+    */
+    inline std::vector<std::string_view> splitChunks(std::string_view data, size_t count, char delim)
+    {
+        size_t pos;
+        size_t end;
+        size_t want;
+        std::vector<std::string_view> chunks;
+        pos = 0;
+        want = ((data.size() / ((count == 0) ? 1 : count)) + 1);
+        while(pos < data.size())
+        {
+            end = (pos + want);
+            if(end >= data.size())
+            {
+                end = data.size();
+            }
+            else
+            {
+                end = data.find(delim, end);
+                end = ((end == std::string_view::npos) ? data.size() : (end + 1));
+            }
+            chunks.push_back(data.substr(pos, end - pos));
+            pos = end;
+        }
+        return chunks;
+    }
+
+    /*
+    * calls $fn for every line (or record, if $delim isn't '\n') in $data,
+    * removing the '\r' of '\r\n' line endings just like LineReader does.
+    */
+    template<typename FuncT>
+    void forEachLine(std::string_view data, char delim, FuncT&& fn)
+    {
+        size_t pos;
+        size_t end;
+        std::string_view line;
+        pos = 0;
+        while(pos < data.size())
+        {
+            end = data.find(delim, pos);
+            if(end == std::string_view::npos)
+            {
+                end = data.size();
+            }
+            line = data.substr(pos, end - pos);
+            if((delim == '\n') && !line.empty() && (line.back() == '\r'))
+            {
+                line.remove_suffix(1);
+            }
+            fn(line);
+            pos = (end + 1);
+        }
+    }
+}
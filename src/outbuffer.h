@@ -0,0 +1,80 @@
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <mutex>
+#include <cstdio>
+
+namespace Shared
+{
+    /*
+    * collects output in memory, and hands it to the FILE* in large blocks - as opposed
+    * to std::endl, which flushes after every single line.
+    * a record passed to write() is never split between two blocks, so several writers
+    * (one per thread) can share one FILE* without their lines getting mixed up, as long
+    * as they share $lock as well.
+    */
+    class BufferedWriter
+    {
+        public:
+            static constexpr size_t DefaultSize = (1024 * 64);
+
+        private:
+            FILE* m_handle;
+            std::mutex* m_lock;
+            size_t m_limit;
+            std::string m_buffer;
+
+        public:
+            BufferedWriter(FILE* fh, std::mutex* lock=nullptr, size_t limit=DefaultSize): m_handle(fh), m_lock(lock), m_limit(limit)
+            {
+                m_buffer.reserve(limit + 1024);
+            }
+
+            ~BufferedWriter()
+            {
+                flush();
+            }
+
+            BufferedWriter(const BufferedWriter&) = delete;
+            BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+            void write(std::string_view str)
+            {
+                m_buffer.append(str.data(), str.size());
+                if(m_buffer.size() >= m_limit)
+                {
+                    flush();
+                }
+            }
+
+            // writes $str, followed by $term, as one record
+            void writeRecord(std::string_view str, char term)
+            {
+                m_buffer.append(str.data(), str.size());
+                m_buffer.push_back(term);
+                if(m_buffer.size() >= m_limit)
+                {
+                    flush();
+                }
+            }
+
+            void flush()
+            {
+                if(m_buffer.empty())
+                {
+                    return;
+                }
+                if(m_lock != nullptr)
+                {
+                    std::lock_guard<std::mutex> guard(*m_lock);
+                    std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_handle);
+                }
+                else
+                {
+                    std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_handle);
+                }
+                m_buffer.clear();
+            }
+    };
+}
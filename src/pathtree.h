@@ -0,0 +1,266 @@
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+namespace Shared
+{
+    /*
+    * a tree of paths, stored as (parent, name) nodes: the names are copied into large
+    * blocks of memory (a bump arena, nothing is ever freed on its own), and a full path
+    * only exists while somebody needs it - see append().
+    * a node is 16 bytes, plus the bytes of its name, plus 8 bytes in the lookup table -
+    * as opposed to a std::filesystem::path, which holds the whole path, and each of
+    * its components, separately allocated.
+    * the name of a root node is a whole path (like "/usr/" or "."); every other name
+    * is a single component, joined to its parent's path with a '/'.
+    */
+    class PathTree
+    {
+        public:
+            static constexpr size_t NoNode = size_t(-1);
+
+        private:
+            static constexpr size_t BlockSize = (1024 * 64);
+            static constexpr uint32_t NoParent = ~uint32_t(0);
+
+            struct Node
+            {
+                uint32_t parent;
+                uint32_t namelen;
+                const char* name;
+            };
+
+        private:
+            std::vector<Node> m_nodes;
+            std::vector<size_t> m_roots;
+            std::vector<std::unique_ptr<char[]>> m_blocks;
+            char* m_blockpos = nullptr;
+            size_t m_blockleft = 0;
+
+            // node index + 1 of every node, by hash of (parent, name); 0 is a free slot
+            std::vector<uint32_t> m_slots;
+
+        private:
+            static uint64_t hashOf(uint32_t parent, std::string_view name)
+            {
+                uint64_t h;
+                // FNV-1a, seeded with the parent
+                h = (0xcbf29ce484222325ull ^ (uint64_t(parent) * 0x9e3779b97f4a7c15ull));
+                for(char ch: name)
+                {
+                    h = ((h ^ uint8_t(ch)) * 0x100000001b3ull);
+                }
+                return (h ^ (h >> 32));
+            }
+
+            const char* store(std::string_view name)
+            {
+                char* dest;
+                if(name.size() > m_blockleft)
+                {
+                    m_blockleft = std::max(BlockSize, name.size());
+                    m_blocks.push_back(std::make_unique<char[]>(m_blockleft));
+                    m_blockpos = m_blocks.back().get();
+                }
+                dest = m_blockpos;
+                std::memcpy(dest, name.data(), name.size());
+                m_blockpos += name.size();
+                m_blockleft -= name.size();
+                return dest;
+            }
+
+            void place(std::vector<uint32_t>& slots, size_t idx) const
+            {
+                size_t i;
+                size_t mask;
+                mask = (slots.size() - 1);
+                for(i=(hashOf(m_nodes[idx].parent, nameOf(idx)) & mask); slots[i] != 0; i=((i + 1) & mask))
+                {
+                }
+                slots[i] = uint32_t(idx + 1);
+            }
+
+            void grow()
+            {
+                size_t i;
+                std::vector<uint32_t> bigger(std::max(size_t(1024), m_slots.size() * 2), 0);
+                for(i=0; i<m_nodes.size(); i++)
+                {
+                    place(bigger, i);
+                }
+                m_slots.swap(bigger);
+            }
+
+            static bool isSeparator(char ch)
+            {
+                #if defined(_WIN32)
+                    return ((ch == '/') || (ch == '\\'));
+                #else
+                    return (ch == '/');
+                #endif
+            }
+
+            std::string_view nameOf(size_t idx) const
+            {
+                return std::string_view(m_nodes[idx].name, m_nodes[idx].namelen);
+            }
+
+            // whether a '/' goes between the path of $idx and the name of a child
+            bool needsSeparator(size_t idx) const
+            {
+                return ((m_nodes[idx].namelen == 0) || !isSeparator(m_nodes[idx].name[m_nodes[idx].namelen - 1]));
+            }
+
+        public:
+            PathTree()
+            {
+            }
+
+            PathTree(const PathTree&) = delete;
+            PathTree& operator=(const PathTree&) = delete;
+
+            size_t size() const
+            {
+                return m_nodes.size();
+            }
+
+            /*
+            * adds a node named $name below $parent (or a root, if $parent is NoNode),
+            * and returns its index. indices are handed out in order, starting at 0.
+            */
+            size_t add(size_t parent, std::string_view name)
+            {
+                Node node;
+                if((m_nodes.size() + 1) * 2 > m_slots.size())
+                {
+                    grow();
+                }
+                node.parent = ((parent == NoNode) ? NoParent : uint32_t(parent));
+                node.namelen = uint32_t(name.size());
+                node.name = store(name);
+                m_nodes.push_back(node);
+                place(m_slots, m_nodes.size() - 1);
+                if(parent == NoNode)
+                {
+                    m_roots.push_back(m_nodes.size() - 1);
+                }
+                return (m_nodes.size() - 1);
+            }
+
+            size_t parent(size_t idx) const
+            {
+                return ((m_nodes[idx].parent == NoParent) ? NoNode : size_t(m_nodes[idx].parent));
+            }
+
+            // the child of $parent called $name, or NoNode
+            size_t child(size_t parent, std::string_view name) const
+            {
+                size_t i;
+                size_t mask;
+                uint32_t idx;
+                if(m_slots.empty())
+                {
+                    return NoNode;
+                }
+                mask = (m_slots.size() - 1);
+                for(i=(hashOf(uint32_t(parent), name) & mask); m_slots[i] != 0; i=((i + 1) & mask))
+                {
+                    idx = (m_slots[i] - 1);
+                    if((m_nodes[idx].parent == uint32_t(parent)) && (nameOf(idx) == name))
+                    {
+                        return idx;
+                    }
+                }
+                return NoNode;
+            }
+
+            /*
+            * the node whose path is $path, or NoNode.
+            * $path is matched component by component, starting from the root that
+            * it begins with.
+            */
+            size_t find(std::string_view path) const
+            {
+                size_t at;
+                size_t end;
+                size_t idx;
+                for(size_t root: m_roots)
+                {
+                    auto rname = nameOf(root);
+                    if((path.size() < rname.size()) || (path.compare(0, rname.size(), rname) != 0))
+                    {
+                        continue;
+                    }
+                    if((path.size() > rname.size()) && needsSeparator(root) && !isSeparator(path[rname.size()]))
+                    {
+                        continue;
+                    }
+                    idx = root;
+                    for(at=rname.size(); (at < path.size()) && (idx != NoNode); at=end)
+                    {
+                        for(; (at < path.size()) && isSeparator(path[at]); at++)
+                        {
+                        }
+                        for(end=at; (end < path.size()) && !isSeparator(path[end]); end++)
+                        {
+                        }
+                        if(end > at)
+                        {
+                            idx = child(idx, path.substr(at, end - at));
+                        }
+                    }
+                    if(idx != NoNode)
+                    {
+                        return idx;
+                    }
+                }
+                return NoNode;
+            }
+
+            /*
+            * appends the path of $idx to $dest.
+            * the length is added up first, so that $dest grows (at most) once, and is
+            * then filled in from the back.
+            */
+            void append(size_t idx, std::string& dest) const
+            {
+                size_t i;
+                size_t len;
+                size_t pos;
+                len = 0;
+                for(i=idx; i!=NoNode; i=parent(i))
+                {
+                    len += m_nodes[i].namelen;
+                    if((parent(i) != NoNode) && needsSeparator(parent(i)))
+                    {
+                        len++;
+                    }
+                }
+                pos = (dest.size() + len);
+                dest.resize(pos);
+                for(i=idx; i!=NoNode; i=parent(i))
+                {
+                    pos -= m_nodes[i].namelen;
+                    std::memcpy(&dest[pos], m_nodes[i].name, m_nodes[i].namelen);
+                    if((parent(i) != NoNode) && needsSeparator(parent(i)))
+                    {
+                        dest[--pos] = '/';
+                    }
+                }
+            }
+
+            std::string path(size_t idx) const
+            {
+                std::string res;
+                append(idx, res);
+                return res;
+            }
+    };
+}
@@ -12,12 +12,23 @@
 #include <set>
 #include <functional>
 #include <string>
+#include <string_view>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <cstring>
 #include <cstdio>
 #if defined(_WIN32)
     #include <io.h>
     #include <fcntl.h>
 #endif
 
+#include "shared.h"
+#include "linereader.h"
+#include "mappedfile.h"
+#include "extlist.h"
+#include "countkernels.h"
+#include "walkstats.h"
 #include "find.hpp"
 #include "optionparser.hpp"
 
@@ -65,6 +76,9 @@ struct Config
     // this is handled via '-f'
     bool readlistings = false;
 
+    // whether paths read via '-i' or '-f' are separated by NUL bytes ('find -print0') instead of newlines
+    bool nulsep = false;
+
     // whether to ignore files that lack a file extension
     bool reject_noext = false;
 
@@ -83,122 +97,103 @@ struct Config
     // whether to be verbose
     bool verbose = false;
 
-    // maximum depth (this doesn't quite seem to work correctly - see find.hpp)
+    // how deep to go: 1 only looks at the entries of the given directories. 0 means unlimited
     size_t maxdepth = 0;
 
-    // where the output is written to. default is std::cout; handled by '-o' flag
-    std::ostream* outstream;
+    // number of threads used to walk directories. 0 means one per core. ignored with '-n' and '-x' (see CountFiles::threadCount())
+    size_t threads = 1;
 
-    // list of dirs to prune
-    std::vector<std::filesystem::path> pruneme = {};
-};
+    // how directories are read (see Find::Finder::Backend); handled by '--backend'
+    Find::Finder::Backend backend = Find::Finder::Backend::Standard;
 
-class ExtList
-{
-    public:
-        template<typename T>
-        using ContainerType = std::deque<T>;
+    // if not empty, directories that haven't changed since the last run are replayed from this file (see Find::DirIndex)
+    std::string indexfile;
 
-        struct Item
-        {
-            std::string ext;
-            size_t count;
-            size_t hash;
-        };
+    // skip whatever .gitignore and .ignore files say to skip; handled by '-G'
+    bool gitignore = false;
 
-    private:
-        ContainerType<size_t> m_seen;
-        ContainerType<Item> m_items;
-        std::hash<std::string> m_hashfn;
+    // don't cross into other filesystems; handled by '-X'
+    bool onefs = false;
 
-    public:
-        ExtList()
-        {
-        }
+    // if not 0, mounts on which reading a directory takes longer than this many milliseconds are skipped; handled by '-M'
+    size_t mountbudget = 0;
 
-        auto begin()
-        {
-            return m_items.begin();
-        }
+    // walk slow mounts last, instead of skipping them; handled by '-D'
+    bool deferslow = false;
 
-        auto end()
-        {
-            return m_items.end();
-        }
+    // print what the walker did to stderr once done (see Find::WalkStats); handled by '-T', and '-J' for JSON
+    bool stats = false;
+    bool statsjson = false;
 
-        auto rbegin()
-        {
-            return m_items.rbegin();
-        }
+    // if not empty, a Chrome trace of the walk is written to this file (see Find::Tracer); handled by '-W'
+    std::string tracefile;
 
-        auto rend()
-        {
-            return m_items.rend();
-        }
+    // if not 0, this many of the slowest directories are printed to stderr; handled by '-K'
+    size_t slowest = 0;
 
-        auto byhash(size_t hash)
-        {
-            return std::find_if(m_items.begin(), m_items.end(),  [&](const Item& item) 
-            { 
-                return (item.hash == hash);
-            });
-        }
+    // where the output is written to. default is std::cout; handled by '-o' flag
+    std::ostream* outstream;
 
-        bool contains(size_t hash, size_t& idx)
-        {
-            auto it = std::find(m_seen.begin(), m_seen.end(), hash);
-            if(it != m_seen.end())
-            {
-                idx = std::distance(m_seen.begin(), it);
-                return true;
-            }
-            return false;
-        }
+    // names, paths or wildcard patterns of directories to prune (see Find::NameRules); handled by '-p'
+    std::vector<std::string> pruneme = {};
 
-        void increase(const std::string& ext)
-        {
-            size_t idx;
-            size_t hash;
-            hash = m_hashfn(ext);
-            if(contains(hash, idx))
-            {
-                m_items[idx].count++;
-            }
-            else
-            {
-                m_seen.push_back(hash);
-                m_items.push_back(Item{ext, 1, hash});
-            }
-        }
+    // same, for files that shouldn't be counted; handled by '-g'
+    std::vector<std::string> ignoreme = {};
 };
 
 class CountFiles
 {
+    public:
+        /*
+        * the counters of one walker thread.
+        * every thread only ever touches its own shard, so counting needs no locks;
+        * the shards are merged into the first one once walking is done.
+        */
+        struct Shard
+        {
+            Shared::ExtList map;
+            size_t padding = 5;
+        };
+
     private:
-        ExtList m_map;
         Config& m_options;
+        std::vector<std::unique_ptr<Shard>> m_shards;
+        Find::DirIndex m_index;
+
+        // added up over all walkDirectory() calls
+        Find::WalkStats m_walkstats;
+
+        // only set if a trace, or the slowest directories, were asked for
+        std::unique_ptr<Find::Tracer> m_tracer;
+
+        // the merged result; only valid after mergeShards()
+        Shared::ExtList& m_map;
         size_t m_padding = 5;
 
     private:
-        void checkPadding(size_t slen)
+        void checkPadding(Shard& sh, size_t slen)
         {
-            if(slen > m_padding)
+            if(slen > sh.padding)
             {
-                m_padding = slen;
+                sh.padding = slen;
             }
         }
 
-        // this function will attempt to remove '\r\n'.
-        // this only applies to listing files.
-        // it will effectively do nothing if the string does not contain a '\r'
-        void fixCR(std::string& str)
+        void ensureShards(size_t count)
         {
-            if(!str.empty() && (str[str.size() - 1] == '\r'))
+            while(m_shards.size() < count)
             {
-                str.erase(str.size() - 1);
+                m_shards.emplace_back(new Shard);
             }
         }
 
+        static std::vector<std::unique_ptr<Shard>> makeShards()
+        {
+            std::vector<std::unique_ptr<Shard>> shards;
+            shards.emplace_back(new Shard);
+            return shards;
+        }
+
         void shortenpath(std::string& rawpath)
         {
             size_t plen;
@@ -213,14 +208,34 @@ class CountFiles
             }
         }
 
-        void push(const std::string& val)
+    public:
+        CountFiles(Config& opts): m_options(opts), m_shards(makeShards()), m_map(m_shards[0]->map)
         {
-            m_map.increase(val);
+            if(!m_options.indexfile.empty())
+            {
+                if(!m_index.load(m_options.indexfile))
+                {
+                    verbose("no usable index in \"%s\", reading everything", m_options.indexfile.c_str());
+                }
+            }
+            if(!m_options.tracefile.empty() || (m_options.slowest > 0))
+            {
+                m_tracer.reset(new Find::Tracer(1024 * 256, std::max(m_options.slowest, size_t(1))));
+            }
         }
 
-    public:
-        CountFiles(Config& opts): m_options(opts)
+        /*
+        * writes back the index, if one was requested.
+        * only called after walking directories, since that's what fills it.
+        */
+        bool saveIndex()
         {
+            if(m_options.indexfile.empty())
+            {
+                return true;
+            }
+            verbose("index: %zu directories reused, %zu read", m_index.reusedCount(), m_index.rescannedCount());
+            return m_index.save(m_options.indexfile);
         }
 
         std::ostream& out()
@@ -239,66 +254,43 @@ class CountFiles
             }
         }
 
-        // this function is where post-processing (like turning strings lowercase)
-        // happens. new options and/or functionality that directly operate
-        // on the input string should be added here.
-        void increase(const std::string& val)
+        /*
+        * with '-n' and '-x', keys are printed in the order they were first found - which,
+        * with several threads, would depend on how they happened to be scheduled. so those
+        * walk (and read listings) on a single thread, and print exactly what a run
+        * without '-j' would.
+        */
+        size_t threadCount()
         {
-            std::string copy;
-            checkPadding(val.size());
-            if(m_options.icase)
+            if(m_options.sortvals && (!m_options.collectonly))
             {
-                copy = val;
-                std::transform(copy.begin(), copy.end(), copy.begin(), ::tolower);
-                push(copy);
+                return m_options.threads;
             }
-            else
+            if(m_options.threads != 1)
             {
-                push(val);
+                verbose("'-n' and '-x' keep the order keys were found in, so ignoring '-j'");
             }
+            return 1;
         }
 
-        void modeExtension(const std::filesystem::path& item)
+        /*
+        * the counting itself (including lowercasing) is in countkernels.h, which the
+        * kernels benchmark uses as well. new options and/or functionality that directly
+        * operate on the input string should be added there.
+        */
+        void modeExtension(Shard& sh, std::string_view item)
         {
-            std::string strext;
-            std::string bnamestr;
-            std::filesystem::path bname;
-            bname = item.filename();
-            bnamestr = bname.string();
-            /*
-            * if the item path is something like "foo/bar/", then
-            * bname is just an empty string, and doesn't contain anything to work with.
-            * theoretically, this shouldn't happen, though.
-            */
-            if(!bnamestr.empty())
-            {
-                strext = bname.extension().string();
-                /*
-                * in some super funky cases, the extension might be something
-                * like "." (i.e., "foo."). i don't who or why someone would
-                * name a file like this, but still.
-                */
-                if(strext.size() > 1)
-                {
-                    increase(strext);
-                }
-                else
-                {
-                    if(!m_options.reject_noext)
-                    {
-                        increase(bname.string());
-                    }
-                }
-            }
+            checkPadding(sh, Shared::countExtension(sh.map, item, m_options.icase, m_options.reject_noext).size());
         }
 
-        void modeStem(const std::filesystem::path& item)
+        void modeStem(Shard& sh, std::string_view item)
         {
-            std::string stemstr;
-            std::filesystem::path stem;
-            stem = item.stem();
-            stemstr = stem.string();
-            increase(stemstr);
+            checkPadding(sh, Shared::countStem(sh.map, item, m_options.icase).size());
+        }
+
+        void modeFilename(Shard& sh, std::string_view item)
+        {
+            checkPadding(sh, Shared::countFilename(sh.map, item, m_options.icase).size());
         }
 
         /*
@@ -308,14 +300,16 @@ class CountFiles
         }
         */
 
-        void handleItem(const std::filesystem::path& item)
+        void handleItem(Shard& sh, std::string_view item)
         {
             switch(m_options.sortkind)
             {
                 case SortKind::Extension:
-                    return modeExtension(item);
+                    return modeExtension(sh, item);
                 case SortKind::Stem:
-                    return modeStem(item);
+                    return modeStem(sh, item);
+                case SortKind::Filename:
+                    return modeFilename(sh, item);
                 /*
                 case SortKind::Filesize:
                     return modeFilesize(item);
@@ -327,103 +321,210 @@ class CountFiles
             }
         }
 
-        void walkFilestream(std::istream& infh)
+        void handleLine(Shard& sh, std::string_view line)
         {
-            std::string line;
-            line.reserve(1024 * 8);
-            while(std::getline(infh, line))
+            if(line.size() >= CFILES_MAXPATHLEN)
             {
-                //fixCR(line);
-                if(line.size() >= CFILES_MAXPATHLEN)
-                {
-                    //shortenpath(line);
-                }
-                verbose("line: %s", line.c_str());
-                try
-                {
-                    handleItem(line);
-                }
-                catch(std::exception& ex)
+                //shortenpath(line);
+            }
+            verbose("line: %.*s", int(line.size()), line.data());
+            try
+            {
+                handleItem(sh, line);
+            }
+            catch(std::exception& ex)
+            {
+                std::cerr << "in walkFilestream: " << ex.what() << "(line: \"" << line << "\")" << std::endl;
+            }
+        }
+
+        char lineDelim() const
+        {
+            return (m_options.nulsep ? '\0' : '\n');
+        }
+
+        // reads paths from $infh - one per line, or NUL-separated with '-0'.
+        // the reader already removes the '\r' of '\r\n' line endings.
+        void walkFilestream(FILE* infh)
+        {
+            std::string_view line;
+            Shared::LineReader rd(infh, lineDelim());
+            while(rd.next(line))
+            {
+                handleLine(*m_shards[0], line);
+            }
+        }
+
+        /*
+        * reads paths from a listing file, by mapping it into memory.
+        * with '-j', the mapping is cut into chunks on line boundaries, which the
+        * threads take turns grabbing, each counting into its own shard - so the
+        * only thing they share is the index of the next chunk.
+        */
+        bool walkListing(const std::string& file)
+        {
+            size_t i;
+            size_t nthreads;
+            std::atomic<size_t> nextchunk(0);
+            std::vector<std::thread> threads;
+            Shared::MappedFile mf;
+            if(!mf.open(file))
+            {
+                return false;
+            }
+            nthreads = Find::Finder::ResolveThreads(threadCount());
+            // more chunks than threads, so that a thread that got a slow chunk doesn't hold up the rest
+            auto chunks = Shared::splitChunks(mf.view(), nthreads * 8, lineDelim());
+            ensureShards(nthreads);
+            auto worker = [&](size_t self)
+            {
+                size_t ci;
+                while((ci = nextchunk++) < chunks.size())
                 {
-                    std::cerr << "in walkFilestream: " << ex.what() << "(line: \"" << line << "\")" << std::endl;
+                    Shared::forEachLine(chunks[ci], lineDelim(), [&](std::string_view line)
+                    {
+                        handleLine(*m_shards[self], line);
+                    });
                 }
+            };
+            for(i=1; i<nthreads; i++)
+            {
+                threads.emplace_back(worker, i);
             }
+            worker(0);
+            for(auto& th: threads)
+            {
+                th.join();
+            }
+            return true;
         }
 
         void walkDirectory(const std::string& dir)
         {
             Find::Finder fi(dir);
             fi.setMaxDepth(m_options.maxdepth);
-            fi.onException([&](const std::exception& ex, const std::string& orig, const std::filesystem::path& p)
+            fi.setThreads(threadCount());
+            fi.setBackend(m_options.backend);
+            if(m_options.gitignore)
             {
-                std::string exmsg;
-                exmsg = ex.what();
+                fi.setIgnoreFiles({".gitignore", ".ignore"});
+            }
+            fi.setOneFilesystem(m_options.onefs);
+            fi.setMountBudget(std::chrono::milliseconds(m_options.mountbudget), m_options.deferslow);
+            fi.setTimeStats(m_options.stats);
+            fi.setTracer(m_tracer.get());
+            if(!m_options.indexfile.empty())
+            {
+                fi.setIndex(&m_index);
+            }
+            fi.onError([&](const Find::Finder::WalkError& err)
+            {
+                std::string msg;
+                msg = Find::Finder::ErrorMessage(err);
                 // FormatMessage() includes CRLF for some reason, so remove that
-                exmsg.erase(std::remove(exmsg.begin(), exmsg.end(), '\r'), exmsg.end());
-                exmsg.erase(std::remove(exmsg.begin(), exmsg.end(), '\n'), exmsg.end());
-                std::cerr << "ERROR: in '" << orig << "': path \"" << p.string() << "\": " << exmsg << std::endl;
+                msg.erase(std::remove(msg.begin(), msg.end(), '\r'), msg.end());
+                msg.erase(std::remove(msg.begin(), msg.end(), '\n'), msg.end());
+                std::cerr << "ERROR: in '" << Find::Finder::PhaseName(err.phase) << "': path \"" << err.path.string() << "\": " << msg << std::endl;
             });
-            fi.skipItemIf([&](const std::filesystem::path& checkthis, bool isdir, bool isfile)
+            for(const auto& rule: m_options.pruneme)
             {
-                (void)isfile;
-                if(isdir)
-                {
-                    verbose("current path: %s", checkthis.string().c_str());
-                }
-                return (isdir);
-            });
+                fi.pruneRules().add(rule);
+            }
+            for(const auto& rule: m_options.ignoreme)
+            {
+                fi.ignoreRules().add(rule);
+            }
 
-            fi.pruneIf([&](const std::filesystem::path& checkthis)
+            ensureShards(fi.threadCount());
+            /*
+            * directories are told apart here rather than with skipItemIf(): a skip callback
+            * takes a std::filesystem::path, which would have to be built for every entry.
+            */
+            fi.walkEntries([&](const Find::Finder::Entry& ent)
             {
-                for(auto& prunethis: m_options.pruneme)
+                std::string tmp;
+                if(ent.isdir)
                 {
-                    if(prunethis.empty())
-                    {
-                        continue;
-                    }
-                    //std::cerr << "checkthis.parent_path() = " << checkthis.parent_path() << std::endl;
-                    //std::cerr << "prunethis.parent_path() = " << prunethis.parent_path().string() << std::endl;
-                    // todo: add option to ignore case maybe?
-                    // first, check if the paths match as-is ...
-                    if(checkthis == prunethis)
-                    {
-                        return true;
-                    }
-                    // then, check if filename (in case of directories, the dirname) is equal ...
-                    if(checkthis.has_parent_path() && ((!prunethis.empty()) && prunethis.has_parent_path()))
+                    if(m_options.verbose)
                     {
-
-                        if(checkthis.parent_path() == prunethis.parent_path())
-                        {
-                            return true;
-                        }
+                        verbose("current path: %s", std::string(ent.pathBytes(tmp)).c_str());
                     }
-                    // lastly, do a lexical check
-                    return ((checkthis.compare(prunethis)) >= 0);
+                    return;
                 }
-                return false;
+                handleItem(*m_shards[ent.worker], ent.pathBytes(tmp));
             });
+            m_walkstats.merge(fi.stats());
+            for(const auto& slow: fi.slowMounts())
+            {
+                std::cerr << "note: the mount of \"" << slow.string() << "\" is slow; "
+                          << (m_options.deferslow ? "it was walked last" : "the rest of it was skipped") << std::endl;
+            }
+        }
+
+        const Find::WalkStats& walkStats() const
+        {
+            return m_walkstats;
+        }
 
-            fi.walk([&](const std::filesystem::path& path)
+        /*
+        * writes the trace, and prints the slowest directories, if either was asked for.
+        * returns false if the trace couldn't be written.
+        */
+        bool finishTrace()
+        {
+            if(!m_tracer)
             {
-                handleItem(path);
-            });
+                return true;
+            }
+            if(m_options.slowest > 0)
+            {
+                Shared::printSlowest(std::cerr, *m_tracer, m_options.slowest);
+            }
+            if(!m_options.tracefile.empty())
+            {
+                return m_tracer->writeChromeTrace(m_options.tracefile);
+            }
+            return true;
         }
 
+        /*
+        * folds the counters of all threads into the first shard.
+        * runs after the walker threads have been joined, so there's nothing to lock.
+        */
+        void mergeShards()
+        {
+            size_t i;
+            m_padding = m_shards[0]->padding;
+            for(i=1; i<m_shards.size(); i++)
+            {
+                m_map.merge(m_shards[i]->map);
+                m_padding = std::max(m_padding, m_shards[i]->padding);
+            }
+            m_shards.resize(1);
+        }
+
+        /*
+        * keys with the same count are ordered by name, so that the output doesn't
+        * depend on the order in which the threads happened to find things.
+        */
         void sort()
         {
-            std::sort(m_map.begin(), m_map.end(), [](const ExtList::Item& lhs, const ExtList::Item& rhs)
+            m_map.sort([](const Shared::ExtList::Item& lhs, const Shared::ExtList::Item& rhs)
             {
+                if(lhs.count == rhs.count)
+                {
+                    return (lhs.ext < rhs.ext);
+                }
                 return (lhs.count < rhs.count);
             });
         }
 
-        ExtList get()
+        const Shared::ExtList& get() const
         {
             return m_map;
         }
 
-        void printVals(const std::string& ext, const size_t& count)
+        void printVals(std::string_view ext, const size_t& count)
         {
             std::stringstream buf;
             size_t realpad;
@@ -440,6 +541,7 @@ class CountFiles
 
         void printOutput()
         {
+            mergeShards();
             if(m_options.sortvals && (!m_options.collectonly))
             {
                 sort();
@@ -478,12 +580,15 @@ int main(int argc, char* argv[])
     // replace LF ("\n") with CRLF ("\r\n"), which
     // messes with cygwin tools
     #if defined(_MSVC) || defined(_WIN32)
+        _setmode(0, _O_BINARY);
         _setmode(1, _O_BINARY);
     #endif
 
+    bool walked;
     OptionParser prs;
     Config opts;
     std::fstream* fhptr;
+    walked = false;
     opts.outstream = &std::cout;
     prs.on({"-i", "--stdin"}, "read input from stdin", [&]
     {
@@ -497,7 +602,7 @@ int main(int argc, char* argv[])
     {
         opts.icase = true;
     });
-    prs.on({"-n", "--nosort"}, "do not sort", [&]
+    prs.on({"-n", "--nosort"}, "do not sort: print in the order found (walks on one thread, regardless of '-j')", [&]
     {
         opts.sortvals = false;
     });
@@ -505,36 +610,64 @@ int main(int argc, char* argv[])
     {
         opts.maxdepth = v.template as<size_t>();
     });
+    prs.on({"-j?", "--threads=?"}, "number of threads used to walk directories (default is 1; 0 means one per core)", [&](const auto& v)
+    {
+        long long n;
+        n = std::stoll(v.str());
+        if(n < 0)
+        {
+            std::cerr << "invalid thread count '" << v.str() << "'" << std::endl;
+            std::exit(1);
+        }
+        opts.threads = size_t(n);
+    });
+    prs.on({"-B?", "--backend=?"}, "how to read directories ('std', 'getdents' or 'uring'. default: 'std')", [&](const auto& v)
+    {
+        if(!Find::Finder::BackendFromString(v.str(), opts.backend))
+        {
+            std::cerr << "unknown backend '" << v.str() << "'" << std::endl;
+            std::exit(1);
+        }
+    });
+    prs.on({"-I?", "--index=?"}, "keep a directory index in this file, and only re-read directories that changed since the last run", [&](const auto& v)
+    {
+        opts.indexfile = v.str();
+    });
     prs.on({"-f", "--listing"}, "interpret arguments as a list of files containing paths", [&]
     {
         opts.readlistings = true;
     });
+    prs.on({"-0", "--null"}, "paths read via '-i' or '-f' are NUL-separated (as written by 'find -print0')", [&]
+    {
+        opts.nulsep = true;
+    });
     prs.on({"-e", "--rnoext"}, "skip files that have no extension", [&]
     {
         opts.reject_noext = true;
     });
-    prs.on({"-p?", "--prune=?"}, "do not enter the specified directory (prune directory)", [&](const auto& v)
+    prs.on({"-p?", "--prune=?"}, "do not enter directories matching this name, path, or wildcard pattern (prune directory)", [&](const auto& v)
     {
-        
-        /*
-        * outstandingly retarded hack incoming:
-        * GNU libstdc++fs is broken enough to attempt to post-parse a path past (!!!) being defined...
-        * hence, say, `std::filesystem::path("./foo")` actually parses ::parent_path() as "." ...
-        * so this unbelievably awful hack "fixes" this issue by appending a faux path, through which
-        * ::parent_path() now points to the actual directory name.
-        *
-        * sidenote: the C++ committee deserves more than plenty of hate for designing this
-        * ambigious garbage in the first place.
-        */
-        #if defined(__CYGWIN__) || defined(__GNUC__)
-            std::filesystem::path dumb("./");
-            dumb /= v.str();
-            dumb /= "/0";
-        #else
-            std::filesystem::path dumb(v.str());
-        #endif
-        //std::cerr << "defined pruning: " << dumb << std::endl;
-        opts.pruneme.push_back(dumb);
+        opts.pruneme.push_back(v.str());
+    });
+    prs.on({"-g?", "--ignore=?"}, "do not count files matching this name, path, or wildcard pattern (like '*.o')", [&](const auto& v)
+    {
+        opts.ignoreme.push_back(v.str());
+    });
+    prs.on({"-G", "--gitignore"}, "skip files and directories ignored by .gitignore and .ignore files (and .git directories)", [&]
+    {
+        opts.gitignore = true;
+    });
+    prs.on({"-X", "--one-file-system"}, "do not descend into directories on other filesystems (like 'du -x')", [&]
+    {
+        opts.onefs = true;
+    });
+    prs.on({"-M?", "--mount-budget=?"}, "skip the rest of a mount once reading one of its directories took longer than this many milliseconds", [&](const auto& v)
+    {
+        opts.mountbudget = std::stoi(v.str());
+    });
+    prs.on({"-D", "--defer-slow"}, "with '-M', walk slow mounts last instead of skipping them", [&]
+    {
+        opts.deferslow = true;
     });
     prs.on({"-o?", "--output=?"}, "write output to file (default: write to stdout)", [&](const auto& v)
     {
@@ -573,7 +706,7 @@ int main(int argc, char* argv[])
                 break;
         }
     });
-    prs.on({"-x", "--collect"}, "collect file modes (extension or otherwise) only, does not print amount", [&]
+    prs.on({"-x", "--collect"}, "collect file modes (extension or otherwise) only, does not print amount (walks on one thread, regardless of '-j')", [&]
     {
         opts.collectonly = true;
     });
@@ -581,6 +714,23 @@ int main(int argc, char* argv[])
     {
         opts.verbose = true;
     });
+    prs.on({"-T", "--stats"}, "print what the directory walker did (directories, entries, stat calls, time per phase) to stderr", [&]
+    {
+        opts.stats = true;
+    });
+    prs.on({"-J", "--stats-json"}, "like '--stats', but as a JSON object", [&]
+    {
+        opts.stats = true;
+        opts.statsjson = true;
+    });
+    prs.on({"-W?", "--trace=?"}, "write a timeline of the walk, per thread, to this file (Chrome trace format; open in ui.perfetto.dev)", [&](const auto& v)
+    {
+        opts.tracefile = v.str();
+    });
+    prs.on({"-K?", "--slowest=?"}, "print this many of the directories that took the longest to read to stderr", [&](const auto& v)
+    {
+        opts.slowest = v.template as<size_t>();
+    });
     try
     {
         prs.parse(argc, argv);
@@ -594,6 +744,7 @@ int main(int argc, char* argv[])
     if((!opts.readstdin) && (prs.size() == 0))
     {
         cf.walkDirectory(".");
+        walked = true;
     }
     else
     {
@@ -602,7 +753,7 @@ int main(int argc, char* argv[])
             //std::cerr << "reading from stdin" << std::endl;
             if(have_filepipe())
             {
-                cf.walkFilestream(std::cin);
+                cf.walkFilestream(stdin);
             }
             else
             {
@@ -615,13 +766,8 @@ int main(int argc, char* argv[])
             auto files = prs.positional();
             for(const auto& file: files)
             {
-                std::fstream fh(file, std::ios::in | std::ios::binary);
-                if(fh.good())
-                {
-                    //std::cerr << "reading paths from \"" << file << "\" ..." << '\n';
-                    cf.walkFilestream(fh);
-                }
-                else
+                //std::cerr << "reading paths from \"" << file << "\" ..." << '\n';
+                if(!cf.walkListing(file))
                 {
                     std::cerr << "failed to open \"" << file << "\" for reading" << '\n';
                 }
@@ -634,9 +780,23 @@ int main(int argc, char* argv[])
             {
                 cf.walkDirectory(dir);
             }
+            walked = true;
         }
     }
+    if(walked && !cf.saveIndex())
+    {
+        std::cerr << "failed to write index \"" << opts.indexfile << "\"" << std::endl;
+    }
     cf.printOutput();
+    if(walked && opts.stats)
+    {
+        opts.outstream->flush();
+        Shared::printWalkStats(std::cerr, cf.walkStats(), opts.statsjson);
+    }
+    if(walked && !cf.finishTrace())
+    {
+        std::cerr << "failed to write trace \"" << opts.tracefile << "\"" << std::endl;
+    }
     //std::cerr << "after printOutput" << std::endl;
     if(opts.mustclose)
     {
@@ -1,4 +1,871 @@
 
+/*
+* ffind - a find(1) workalike, built on Find::Finder.
+*
+* usage: ffind [<dir> ...] [<expression>]
+*
+* the expression is compiled once into a flat array of nodes, and evaluated while
+* the walker reads directories - a directory that the expression prunes is never
+* opened. stat data is only asked for if a test needs it (-size, -mtime, -mmin),
+* so most expressions are answered from getdents' d_type alone.
+*/
+
+/* must be first header, due to msvc stuff */
+#include "glue.h"
+
 #include <iostream>
-#include <>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <stdexcept>
+#include <limits>
+#include <chrono>
+#include <cstdio>
+#if defined(_WIN32)
+    #include <io.h>
+    #include <fcntl.h>
+#endif
+#include "shared.h"
+#include "outbuffer.h"
+#include "find.hpp"
+#include "findrules.hpp"
+
+struct Config
+{
+    size_t threads = 1;
+    #if defined(__linux__)
+        Find::Finder::Backend backend = Find::Finder::Backend::Getdents;
+    #else
+        Find::Finder::Backend backend = Find::Finder::Backend::Standard;
+    #endif
+
+    // entries above $mindepth aren't tested at all, entries below $maxdepth aren't read
+    size_t mindepth = 0;
+    size_t maxdepth = std::numeric_limits<size_t>::max();
+
+    // -xdev: stay on the filesystems of the start directories
+    bool xdev = false;
+};
+
+class Expression
+{
+    public:
+        enum class Op
+        {
+            And,
+            Or,
+            Not,
+            True,
+            False,
+            Name,
+            Path,
+            Ext,
+            Type,
+            Size,
+            Mtime,
+            Prune,
+            Print,
+        };
+
+        enum class Cmp
+        {
+            Less,
+            Equal,
+            Greater,
+        };
+
+        // bits of Node::types
+        enum
+        {
+            TypeFile = (1 << 0),
+            TypeDir  = (1 << 1),
+            TypeLink = (1 << 2),
+        };
+
+        struct Node
+        {
+            Op op;
+
+            // operands of And/Or/Not, as indices into m_nodes
+            size_t lhs = 0;
+            size_t rhs = 0;
+
+            // for Name/Path: index into m_patterns. for Ext: index into m_extlists
+            size_t arg = 0;
+
+            // for Size/Mtime: what (size / unit, rounded up) or (age / unit, rounded down) is compared against
+            Cmp cmp = Cmp::Equal;
+            int64_t num = 0;
+            int64_t unit = 1;
+
+            // for Type: any of TypeFile, TypeDir, TypeLink
+            unsigned types = 0;
+
+            // for Print: the record terminator
+            char term = '\n';
+        };
+
+        /*
+        * what the nodes are evaluated against.
+        * $path is the path as it is printed; $out is the writer of the current thread.
+        */
+        struct Context
+        {
+            const Find::Finder::Entry& ent;
+            std::string_view path;
+            Shared::BufferedWriter& out;
+            bool prune = false;
+
+            // see statOf()
+            bool statdone = false;
+            const Find::StatInfo* statp = nullptr;
+            Find::StatInfo linkstat;
+
+            Context(const Find::Finder::Entry& e, std::string_view p, Shared::BufferedWriter& o): ent(e), path(p), out(o)
+            {
+            }
+        };
+
+    private:
+        Config& m_cfg;
+        std::vector<Node> m_nodes;
+        std::vector<Find::GlobPattern> m_patterns;
+        std::vector<std::vector<std::string>> m_extlists;
+        size_t m_root = 0;
+        bool m_needstat = false;
+        bool m_hasaction = false;
+        // whether Entry::islink can be trusted for files, too - see isLink()
+        bool m_linkknown = false;
+        int64_t m_now = 0;
+
+        // parser state
+        std::vector<std::string> m_args;
+        size_t m_pos = 0;
+
+    private:
+        size_t addNode(const Node& node)
+        {
+            m_nodes.push_back(node);
+            return (m_nodes.size() - 1);
+        }
+
+        size_t addBinary(Op op, size_t lhs, size_t rhs)
+        {
+            Node node;
+            node.op = op;
+            node.lhs = lhs;
+            node.rhs = rhs;
+            return addNode(node);
+        }
+
+        size_t addSimple(Op op)
+        {
+            Node node;
+            node.op = op;
+            return addNode(node);
+        }
+
+        bool atEnd() const
+        {
+            return (m_pos >= m_args.size());
+        }
+
+        const std::string& peek() const
+        {
+            return m_args[m_pos];
+        }
+
+        const std::string& argumentOf(const std::string& name)
+        {
+            if(atEnd())
+            {
+                throw std::runtime_error("missing argument to '" + name + "'");
+            }
+            return m_args[m_pos++];
+        }
+
+        static int64_t parseNumber(const std::string& name, const std::string& str)
+        {
+            size_t end;
+            int64_t val;
+            try
+            {
+                val = std::stoll(str, &end);
+            }
+            catch(std::exception&)
+            {
+                end = 0;
+            }
+            if((end == 0) || (end != str.size()) || (val < 0))
+            {
+                throw std::runtime_error("invalid argument '" + str + "' to '" + name + "'");
+            }
+            return val;
+        }
+
+        /*
+        * parses "+N", "-N" or "N" (with an optional unit suffix, for -size),
+        * the way find does.
+        */
+        void parseComparison(Node& node, const std::string& name, std::string str, bool withunit)
+        {
+            node.cmp = Cmp::Equal;
+            if(!str.empty() && (str[0] == '+'))
+            {
+                node.cmp = Cmp::Greater;
+                str.erase(0, 1);
+            }
+            else if(!str.empty() && (str[0] == '-'))
+            {
+                node.cmp = Cmp::Less;
+                str.erase(0, 1);
+            }
+            if(withunit)
+            {
+                // find counts in 512-byte blocks, unless told otherwise
+                node.unit = 512;
+                if(!str.empty() && !std::isdigit((unsigned char)str.back()))
+                {
+                    switch(str.back())
+                    {
+                        case 'c': node.unit = 1; break;
+                        case 'w': node.unit = 2; break;
+                        case 'b': node.unit = 512; break;
+                        case 'k': node.unit = 1024; break;
+                        case 'M': node.unit = (1024 * 1024); break;
+                        case 'G': node.unit = (1024 * 1024 * 1024); break;
+                        default:
+                            throw std::runtime_error("invalid unit in '" + str + "' for '" + name + "'");
+                    }
+                    str.pop_back();
+                }
+            }
+            node.num = parseNumber(name, str);
+        }
+
+        size_t parseType(const std::string& name, const std::string& str)
+        {
+            Node node;
+            node.op = Op::Type;
+            for(char ch: str)
+            {
+                switch(ch)
+                {
+                    case 'f': node.types |= TypeFile; break;
+                    case 'd': node.types |= TypeDir; break;
+                    case 'l': node.types |= TypeLink; break;
+                    case ',': break;
+                    default:
+                        throw std::runtime_error("unsupported type '" + std::string(1, ch) + "' for '" + name + "'");
+                }
+            }
+            if(node.types == 0)
+            {
+                throw std::runtime_error("missing type for '" + name + "'");
+            }
+            return addNode(node);
+        }
+
+        /*
+        * "-ext c,h" matches "foo.c" and "foo.h". the leading dot is optional.
+        */
+        size_t parseExt(const std::string& str, bool icase)
+        {
+            size_t pos;
+            size_t end;
+            std::string ext;
+            std::vector<std::string> exts;
+            Node node;
+            pos = 0;
+            while(pos <= str.size())
+            {
+                end = str.find(',', pos);
+                if(end == std::string::npos)
+                {
+                    end = str.size();
+                }
+                ext = str.substr(pos, end - pos);
+                if(!ext.empty())
+                {
+                    if(ext[0] != '.')
+                    {
+                        ext.insert(0, 1, '.');
+                    }
+                    if(icase)
+                    {
+                        for(auto& ch: ext)
+                        {
+                            ch = std::tolower((unsigned char)ch);
+                        }
+                    }
+                    exts.push_back(ext);
+                }
+                pos = (end + 1);
+            }
+            m_extlists.push_back(std::move(exts));
+            node.op = Op::Ext;
+            node.arg = (m_extlists.size() - 1);
+            node.num = (icase ? 1 : 0);
+            return addNode(node);
+        }
+
+        size_t parsePattern(Op op, const std::string& str, bool icase)
+        {
+            Node node;
+            m_patterns.emplace_back(str, icase);
+            node.op = op;
+            node.arg = (m_patterns.size() - 1);
+            return addNode(node);
+        }
+
+        size_t parsePrimary()
+        {
+            Node node;
+            std::string tok;
+            if(atEnd())
+            {
+                throw std::runtime_error("expected an expression");
+            }
+            tok = m_args[m_pos++];
+            if(tok == "(")
+            {
+                auto inner = parseOr();
+                if(atEnd() || (peek() != ")"))
+                {
+                    throw std::runtime_error("missing ')'");
+                }
+                m_pos++;
+                return inner;
+            }
+            if((tok == "!") || (tok == "-not"))
+            {
+                auto operand = parsePrimary();
+                return addBinary(Op::Not, operand, operand);
+            }
+            if((tok == "-name") || (tok == "-iname"))
+            {
+                return parsePattern(Op::Name, argumentOf(tok), (tok == "-iname"));
+            }
+            if((tok == "-path") || (tok == "-ipath") || (tok == "-wholename"))
+            {
+                return parsePattern(Op::Path, argumentOf(tok), (tok == "-ipath"));
+            }
+            if((tok == "-ext") || (tok == "-iext"))
+            {
+                return parseExt(argumentOf(tok), (tok == "-iext"));
+            }
+            if(tok == "-type")
+            {
+                return parseType(tok, argumentOf(tok));
+            }
+            if(tok == "-size")
+            {
+                node.op = Op::Size;
+                parseComparison(node, tok, argumentOf(tok), true);
+                m_needstat = true;
+                return addNode(node);
+            }
+            if((tok == "-mtime") || (tok == "-mmin"))
+            {
+                node.op = Op::Mtime;
+                parseComparison(node, tok, argumentOf(tok), false);
+                node.unit = ((tok == "-mtime") ? (int64_t(86400) * 1000000000) : (int64_t(60) * 1000000000));
+                m_needstat = true;
+                return addNode(node);
+            }
+            if(tok == "-true")
+            {
+                return addSimple(Op::True);
+            }
+            if(tok == "-false")
+            {
+                return addSimple(Op::False);
+            }
+            if(tok == "-prune")
+            {
+                return addSimple(Op::Prune);
+            }
+            if((tok == "-print") || (tok == "-print0"))
+            {
+                node.op = Op::Print;
+                node.term = ((tok == "-print0") ? '\0' : '\n');
+                m_hasaction = true;
+                return addNode(node);
+            }
+            /*
+            * options. like in find, they aren't positional, and always true.
+            */
+            if((tok == "-maxdepth") || (tok == "-mindepth"))
+            {
+                auto val = parseNumber(tok, argumentOf(tok));
+                ((tok == "-maxdepth") ? m_cfg.maxdepth : m_cfg.mindepth) = val;
+                return addSimple(Op::True);
+            }
+            if((tok == "-j") || (tok == "-threads"))
+            {
+                m_cfg.threads = parseNumber(tok, argumentOf(tok));
+                return addSimple(Op::True);
+            }
+            if((tok == "-xdev") || (tok == "-mount"))
+            {
+                m_cfg.xdev = true;
+                return addSimple(Op::True);
+            }
+            if(tok == "-backend")
+            {
+                if(!Find::Finder::BackendFromString(argumentOf(tok), m_cfg.backend))
+                {
+                    throw std::runtime_error("unknown backend '" + m_args[m_pos - 1] + "'");
+                }
+                return addSimple(Op::True);
+            }
+            throw std::runtime_error("unknown predicate '" + tok + "'");
+        }
+
+        // "a b" is short for "a -a b"
+        size_t parseAnd()
+        {
+            size_t lhs;
+            lhs = parsePrimary();
+            while(!atEnd())
+            {
+                if((peek() == "-o") || (peek() == "-or") || (peek() == ")") || (peek() == ","))
+                {
+                    break;
+                }
+                if((peek() == "-a") || (peek() == "-and"))
+                {
+                    m_pos++;
+                }
+                lhs = addBinary(Op::And, lhs, parsePrimary());
+            }
+            return lhs;
+        }
+
+        size_t parseOr()
+        {
+            size_t lhs;
+            lhs = parseAnd();
+            while(!atEnd() && ((peek() == "-o") || (peek() == "-or")))
+            {
+                m_pos++;
+                lhs = addBinary(Op::Or, lhs, parseAnd());
+            }
+            return lhs;
+        }
+
+        static bool compare(Cmp cmp, int64_t val, int64_t num)
+        {
+            switch(cmp)
+            {
+                case Cmp::Less:
+                    return (val < num);
+                case Cmp::Greater:
+                    return (val > num);
+                default:
+                    break;
+            }
+            return (val == num);
+        }
+
+        /*
+        * the standard backend only checks directories for being symlinks,
+        * so anything else gets an extra lstat() - but only if a test asks.
+        */
+        bool isLink(const Context& ctx) const
+        {
+            std::error_code ecode;
+            if(m_linkknown || ctx.ent.isdir)
+            {
+                return ctx.ent.islink;
+            }
+            return std::filesystem::is_symlink(std::filesystem::symlink_status(ctx.ent.path(), ecode));
+        }
+
+        /*
+        * the stat data -size and -mtime look at. like find without -L, that's the data
+        * of a symlink itself, not of what it points to (which is what the walker provides),
+        * so symlinks get an lstat() of their own. returns null if there's no data.
+        */
+        const Find::StatInfo* statOf(Context& ctx) const
+        {
+            if(!ctx.statdone)
+            {
+                ctx.statdone = true;
+                if(isLink(ctx))
+                {
+                    #if defined(__unix__) || defined(__linux__)
+                        struct stat st;
+                        if(lstat(std::string(ctx.path).c_str(), &st) == 0)
+                        {
+                            ctx.linkstat.size = st.st_size;
+                            ctx.linkstat.mtime = ((int64_t(st.st_mtime) * 1000000000));
+                            ctx.statp = &ctx.linkstat;
+                        }
+                        return ctx.statp;
+                    #endif
+                }
+                if(ctx.ent.hasstat)
+                {
+                    ctx.statp = &ctx.ent.stat;
+                }
+            }
+            return ctx.statp;
+        }
+
+        bool matchExt(const Node& node, const Context& ctx) const
+        {
+            char buf[256];
+            std::string_view ext;
+            ext = Shared::pathExtension(Shared::pathFilename(ctx.path));
+            if(ext.empty())
+            {
+                return false;
+            }
+            if(node.num != 0)
+            {
+                if(ext.size() > sizeof(buf))
+                {
+                    return false;
+                }
+                ext = Shared::asciiLower(ext, buf);
+            }
+            for(const auto& want: m_extlists[node.arg])
+            {
+                if(ext == want)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool eval(size_t idx, Context& ctx) const
+        {
+            bool islink;
+            const Find::StatInfo* st;
+            const Node& node = m_nodes[idx];
+            switch(node.op)
+            {
+                case Op::And:
+                    return (eval(node.lhs, ctx) && eval(node.rhs, ctx));
+                case Op::Or:
+                    return (eval(node.lhs, ctx) || eval(node.rhs, ctx));
+                case Op::Not:
+                    return !eval(node.lhs, ctx);
+                case Op::True:
+                    return true;
+                case Op::False:
+                    return false;
+                case Op::Name:
+                    return m_patterns[node.arg].match(Shared::pathFilename(ctx.path));
+                case Op::Path:
+                    return m_patterns[node.arg].match(ctx.path);
+                case Op::Ext:
+                    return matchExt(node, ctx);
+                case Op::Type:
+                    islink = isLink(ctx);
+                    // like find without -L, a symlink is a symlink, no matter what it points to
+                    if(islink)
+                    {
+                        return ((node.types & TypeLink) != 0);
+                    }
+                    return (
+                        (((node.types & TypeFile) != 0) && ctx.ent.isfile) ||
+                        (((node.types & TypeDir) != 0) && ctx.ent.isdir)
+                    );
+                case Op::Size:
+                    if((st = statOf(ctx)) == nullptr)
+                    {
+                        return false;
+                    }
+                    // rounded up, so a 1-byte file is 1 block, not 0
+                    return compare(node.cmp, (int64_t(st->size) + (node.unit - 1)) / node.unit, node.num);
+                case Op::Mtime:
+                    if((st = statOf(ctx)) == nullptr)
+                    {
+                        return false;
+                    }
+                    return compare(node.cmp, (m_now - st->mtime) / node.unit, node.num);
+                case Op::Prune:
+                    ctx.prune = true;
+                    return true;
+                case Op::Print:
+                    ctx.out.writeRecord(ctx.path, node.term);
+                    return true;
+            }
+            return false;
+        }
+
+    public:
+        Expression(Config& cfg): m_cfg(cfg)
+        {
+        }
+
+        /*
+        * compiles $args. throws std::runtime_error if they don't make sense.
+        */
+        void compile(const std::vector<std::string>& args)
+        {
+            size_t print;
+            m_args = args;
+            m_pos = 0;
+            if(m_args.empty())
+            {
+                m_root = addSimple(Op::True);
+            }
+            else
+            {
+                m_root = parseOr();
+                if(!atEnd())
+                {
+                    throw std::runtime_error("unexpected '" + peek() + "'");
+                }
+            }
+            // an expression without actions prints whatever it's true for
+            if(!m_hasaction)
+            {
+                print = addSimple(Op::Print);
+                m_root = addBinary(Op::And, m_root, print);
+            }
+            m_now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            m_args.clear();
+        }
+
+        bool needStat() const
+        {
+            return m_needstat;
+        }
+
+        void setLinkKnown(bool b)
+        {
+            m_linkknown = b;
+        }
+
+        /*
+        * evaluates the expression for $ctx.
+        * returns false if $ctx.ent is a directory that must not be descended into.
+        */
+        bool evaluate(Context& ctx) const
+        {
+            eval(m_root, ctx);
+            return !ctx.prune;
+        }
+};
+
+class Program
+{
+    private:
+        Config& m_cfg;
+        Expression& m_expr;
+        std::mutex m_outlock;
+        std::vector<std::unique_ptr<Shared::BufferedWriter>> m_writers;
+        std::atomic<bool> m_failed;
+
+    private:
+        /*
+        * prints an error - after what $out has buffered, so that it shows up after the
+        * entries that were found before it. $out must be the writer of the calling
+        * thread: the others may be written to at the same time.
+        */
+        void complain(Shared::BufferedWriter& out, const std::string& path, const std::string& msg)
+        {
+            out.flush();
+            std::fflush(stdout);
+            std::cerr << "ffind: '" << path << "': " << msg << std::endl;
+            m_failed = true;
+        }
+
+        /*
+        * tests an entry, and returns whether to descend into it.
+        */
+        bool visit(const Find::Finder::Entry& ent)
+        {
+            std::string tmp;
+            if(ent.depth < m_cfg.mindepth)
+            {
+                return (ent.depth < m_cfg.maxdepth);
+            }
+            Expression::Context ctx(ent, ent.pathBytes(tmp), *m_writers[ent.worker]);
+            if(!m_expr.evaluate(ctx))
+            {
+                return false;
+            }
+            return (ent.depth < m_cfg.maxdepth);
+        }
+
+        /*
+        * the starting points are tested like everything else (find does that too),
+        * but the walker doesn't hand them out, so they're stat'd here.
+        * returns whether $path should be walked.
+        */
+        bool visitStart(const std::filesystem::path& path)
+        {
+            std::error_code ecode;
+            auto status = std::filesystem::status(path, ecode);
+            if(ecode)
+            {
+                complain(*m_writers[0], path.string(), ecode.message());
+                return false;
+            }
+            Find::Finder::Entry ent(path, path, 0, 0);
+            ent.isdir = std::filesystem::is_directory(status);
+            ent.isfile = std::filesystem::is_regular_file(status);
+            ent.islink = std::filesystem::is_symlink(std::filesystem::symlink_status(path, ecode));
+            if(m_expr.needStat())
+            {
+                ent.hasstat = true;
+                #if defined(__linux__)
+                    struct stat st;
+                    if(stat(path.c_str(), &st) == 0)
+                    {
+                        Find::Detail::fillStatInfo(st, ent.stat);
+                    }
+                #else
+                    if(ent.isfile)
+                    {
+                        ent.stat.size = std::filesystem::file_size(path, ecode);
+                    }
+                    Find::Detail::pathMtime(path, ent.stat.mtime);
+                #endif
+            }
+            // like find -P, a symlink is not followed, not even as a starting point
+            return (visit(ent) && ent.isdir && !ent.islink);
+        }
+
+    public:
+        Program(Config& cfg, Expression& expr): m_cfg(cfg), m_expr(expr), m_failed(false)
+        {
+        }
+
+        int main(const std::vector<std::string>& startdirs)
+        {
+            size_t i;
+            std::vector<std::filesystem::path> walkme;
+            Find::Finder fi;
+            fi.setThreads(m_cfg.threads);
+            fi.setBackend(m_cfg.backend);
+            fi.setWantStat(m_expr.needStat());
+            fi.setOneFilesystem(m_cfg.xdev);
+            #if defined(__linux__)
+                m_expr.setLinkKnown(m_cfg.backend != Find::Finder::Backend::Standard);
+            #endif
+            for(i=0; i<fi.threadCount(); i++)
+            {
+                m_writers.push_back(std::make_unique<Shared::BufferedWriter>(stdout, &m_outlock));
+            }
+            for(const auto& dir: startdirs)
+            {
+                if(visitStart(dir))
+                {
+                    walkme.push_back(dir);
+                }
+            }
+            // so that the starting points come first
+            m_writers[0]->flush();
+            for(const auto& dir: walkme)
+            {
+                fi.addDirectory(dir);
+            }
+            fi.onError([&](const Find::Finder::WalkError& err)
+            {
+                complain(*m_writers[err.worker], err.path.string(), Find::Finder::ErrorMessage(err));
+            });
+            if(!walkme.empty())
+            {
+                try
+                {
+                    fi.walkVisit([&](const Find::Finder::Entry& ent)
+                    {
+                        return visit(ent);
+                    });
+                }
+                catch(std::runtime_error& ex)
+                {
+                    // the walker threads are done by now
+                    complain(*m_writers[0], "", ex.what());
+                }
+            }
+            m_writers.clear();
+            std::fflush(stdout);
+            return (m_failed ? 1 : 0);
+        }
+};
+
+static void usage(const char* argv0)
+{
+    std::printf(
+        "usage: %s [<dir> ...] [<expression>]\n"
+        "\n"
+        "tests:\n"
+        "  -name <glob>, -iname <glob>   match the filename against a wildcard pattern\n"
+        "  -path <glob>, -ipath <glob>   match the entire path against a wildcard pattern\n"
+        "  -ext <list>, -iext <list>     match the extension against a comma separated list (like 'c,h')\n"
+        "  -type <f|d|l>[,...]           match files, directories, or symlinks\n"
+        "  -size [+-]<n>[cwbkMG]         match by size, as in find(1)\n"
+        "  -mtime [+-]<n>, -mmin [+-]<n> match by modification time, in days or minutes\n"
+        "  -true, -false\n"
+        "\n"
+        "actions:\n"
+        "  -print, -print0               print the path, followed by newline or NUL\n"
+        "  -prune                        do not descend into this directory\n"
+        "\n"
+        "operators: ( <expr> ), ! <expr>, -not, -a, -and, -o, -or\n"
+        "\n"
+        "options (anywhere in the expression):\n"
+        "  -maxdepth <n>, -mindepth <n>  limit the depth that is tested/walked\n"
+        "  -xdev, -mount                 do not descend into directories on other filesystems\n"
+        "  -j <n>, -threads <n>          walk directories on <n> threads (0 means one per core)\n"
+        "  -backend <std|getdents|uring> how directories are read\n",
+        argv0
+    );
+}
 
+int main(int argc, char* argv[])
+{
+    int i;
+    std::string arg;
+    std::vector<std::string> dirs;
+    std::vector<std::string> exprargs;
+    Config cfg;
+    Expression expr(cfg);
+    #if defined(_MSVC) || defined(_WIN32)
+        _setmode(1, _O_BINARY);
+    #endif
+    // like in find, the starting points come first, and the expression begins at the first argument that looks like one
+    for(i=1; i<argc; i++)
+    {
+        arg = argv[i];
+        if((arg == "-h") || (arg == "--help"))
+        {
+            usage(argv[0]);
+            return 0;
+        }
+        if(exprargs.empty() && !((arg.size() > 1) && (arg[0] == '-')) && (arg != "(") && (arg != "!"))
+        {
+            dirs.push_back(arg);
+        }
+        else
+        {
+            exprargs.push_back(arg);
+        }
+    }
+    if(dirs.empty())
+    {
+        dirs.push_back(".");
+    }
+    try
+    {
+        expr.compile(exprargs);
+    }
+    catch(std::runtime_error& ex)
+    {
+        std::cerr << "ffind: " << ex.what() << std::endl;
+        return 1;
+    }
+    Program pg(cfg, expr);
+    return pg.main(dirs);
+}
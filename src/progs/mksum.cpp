@@ -1,124 +1,279 @@
 
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <cstdio>
+#include <cstdarg>
 #include "shared.h"
+#include "linereader.h"
+#include "mappedfile.h"
+#include "sizeparse.h"
+#include "optionparser.hpp"
 
-static const auto UNITS = std::map<char, int64_t>{
-    {'B', 1},
-    {'K', 1024},
-    {'M', 1048576},
-    {'G', 1073741824},
-    {'T', 1099511627776},
-    {'P', 1125899906842624},
-    {'E', 1152921504606846976},
+struct Config
+{
+    // number of threads that sum up files. 0 means one per core.
+    size_t threads = 1;
+
+    // print a grand total after the per-file results
+    bool total = false;
 };
 
 struct MkSum
 {
     int64_t m_bytes = 0;
 
-    void processLine(const std::string& line)
-    {
-        int ch;
-        size_t ofs;
-        size_t efs;
-        double dval;
-        double byteval;
-        std::string nstr;
-        ofs = 0;
-        // skip initial spaces
-        while(std::isspace(line[ofs]))
+    // if set, error messages are collected here rather than printed, so that they
+    // can be printed in order once all threads are done.
+    std::string* m_errors = nullptr;
+
+    void complain(const char* fmt, ...)
+    {
+        int len;
+        va_list va;
+        va_list vacopy;
+        va_start(va, fmt);
+        if(m_errors == nullptr)
         {
-            ofs++;
+            vfprintf(stderr, fmt, va);
         }
-        // continue only if line wasn't empty
-        if(ofs < line.length())
+        else
         {
-            efs = 0;
-            // search for digits
-            while(std::isdigit(line[ofs + efs]) || (line[ofs + efs] == '.'))
+            va_copy(vacopy, va);
+            len = vsnprintf(nullptr, 0, fmt, vacopy);
+            va_end(vacopy);
+            if(len > 0)
             {
-                efs++;
-            }
-            // if efs equals ofs, then there were none!
-            if(efs == ofs)
-            {
-                fprintf(stderr, "error: line does not begin with numbers: %.*s\n", int(line.size()), line.data());
-            }
-            else
-            {
-                ch = std::toupper(line[efs]);
-                nstr = line.substr(ofs, efs);
-                auto unit = UNITS.find(ch);
-                if(unit != UNITS.end())
-                {
-                    dval = std::stod(nstr);
-                    byteval = (dval * unit->second);
-                    #if 0
-                    fprintf(stderr, "line: <<%.*s>>, nstr=<<%.*s>>, ofs=%d, efs=%d, ch=%c, dval=%f, byteval=%f\n",
-                        line.size(), line.c_str(), nstr.size(), nstr.c_str(), ofs, efs, ch, dval, byteval);
-                    fprintf(stderr, "m_bytes is now: %d\n", m_bytes);
-                    #endif
-                    m_bytes += byteval;
-                }
-                else
-                {
-                    fprintf(stderr, "error: line has unrecognized unit character '%c': %.*s\n", ch, int(line.size()), line.data());
-                }
+                std::string tmp(len + 1, 0);
+                vsnprintf(&tmp[0], tmp.size(), fmt, va);
+                tmp.pop_back();
+                m_errors->append(tmp);
             }
         }
+        va_end(va);
+    }
+
+    void processLine(std::string_view line)
+    {
+        Shared::ParsedSize ps;
+        switch(Shared::parseSizeLine(line, ps))
+        {
+            case Shared::SizeParseStatus::Ok:
+                m_bytes += Shared::sizeToBytes(ps);
+                break;
+            case Shared::SizeParseStatus::Empty:
+                break;
+            case Shared::SizeParseStatus::NoNumber:
+                complain("error: line does not begin with numbers: %.*s\n", int(line.size()), line.data());
+                break;
+            case Shared::SizeParseStatus::BadUnit:
+                complain("error: line has unrecognized unit character '%c': %.*s\n", std::toupper(ps.unitch), int(line.size()), line.data());
+                break;
+        }
     }
 
-    void readHandle(std::istream& ifs)
+    void readHandle(FILE* ifs)
     {
-        std::string line;
-        // gcc's libstdc++ does not correctly allocate std::string for some reason
-        line.reserve(1024);
-        while(std::getline(ifs, line))
+        std::string_view line;
+        Shared::LineReader rd(ifs);
+        while(rd.next(line))
         {
             processLine(line);
         }
     }
 
+    void readData(std::string_view data)
+    {
+        Shared::forEachLine(data, '\n', [&](std::string_view line)
+        {
+            processLine(line);
+        });
+    }
+
     void result(const std::string& filename)
     {
         std::cout << Shared::sizeToReadable(m_bytes) << " " << filename << " (" << int64_t(m_bytes) << " bytes)" << std::endl;
     }
 };
 
-void doHandle(std::istream& ifs, const std::string& filename)
+/*
+* sums up all $files on $nthreads threads.
+* every file is mapped, and cut into newline-aligned chunks, so that a single big file
+* is spread across all threads just like many small ones are. each chunk gets its own
+* accumulator; since those hold whole bytes, adding them up per file (in the order of
+* the chunks) gives exactly what reading the file front to back would have.
+* results, error messages and the total are printed in the order of $files.
+*/
+int sumParallel(const std::vector<std::string>& files, const Config& cfg)
 {
-    MkSum mks;
-    mks.readHandle(ifs);
-    mks.result(filename);
+    // a chunk smaller than this isn't worth handing to another thread
+    static constexpr size_t MinChunkSize = (1024 * 1024);
+    struct Input
+    {
+        std::string name;
+        Shared::MappedFile mf;
+        bool good = false;
+        size_t firstjob = 0;
+        size_t jobcount = 0;
+    };
+    struct Job
+    {
+        std::string_view data;
+        MkSum sum;
+        std::string errors;
+    };
+    size_t i;
+    size_t nchunks;
+    size_t nthreads;
+    int errc;
+    MkSum total;
+    std::atomic<size_t> nextjob(0);
+    std::vector<std::unique_ptr<Input>> inputs;
+    std::vector<Job> jobs;
+    std::vector<std::thread> threads;
+    errc = 0;
+    nthreads = std::max(size_t(1), cfg.threads);
+    for(const auto& file: files)
+    {
+        auto inp = std::make_unique<Input>();
+        inp->name = file;
+        inp->good = inp->mf.open(file);
+        if(inp->good)
+        {
+            auto data = inp->mf.view();
+            nchunks = std::min(nthreads * 4, (data.size() / MinChunkSize) + 1);
+            inp->firstjob = jobs.size();
+            for(auto chunk: Shared::splitChunks(data, nchunks, '\n'))
+            {
+                jobs.emplace_back();
+                jobs.back().data = chunk;
+            }
+            inp->jobcount = (jobs.size() - inp->firstjob);
+        }
+        inputs.push_back(std::move(inp));
+    }
+    auto worker = [&]
+    {
+        size_t idx;
+        while((idx = nextjob++) < jobs.size())
+        {
+            auto& job = jobs[idx];
+            job.sum.m_errors = &job.errors;
+            job.sum.readData(job.data);
+        }
+    };
+    nthreads = std::min(nthreads, std::max(size_t(1), jobs.size()));
+    for(i=1; i<nthreads; i++)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for(auto& th: threads)
+    {
+        th.join();
+    }
+    for(auto& inp: inputs)
+    {
+        if(!inp->good)
+        {
+            std::cerr << "failed to open \"" << inp->name << "\" for reading" << std::endl;
+            errc += 1;
+            continue;
+        }
+        MkSum mks;
+        for(i=inp->firstjob; i<(inp->firstjob + inp->jobcount); i++)
+        {
+            std::fputs(jobs[i].errors.c_str(), stderr);
+            mks.m_bytes += jobs[i].sum.m_bytes;
+        }
+        mks.result(inp->name);
+        total.m_bytes += mks.m_bytes;
+    }
+    if(cfg.total)
+    {
+        total.result("total");
+    }
+    return errc;
 }
 
+int sumSequential(const std::vector<std::string>& files, const Config& cfg)
+{
+    int errc;
+    MkSum total;
+    errc = 0;
+    for(const auto& filename: files)
+    {
+        FILE* hnd = std::fopen(filename.c_str(), "rb");
+        if(hnd != nullptr)
+        {
+            MkSum mks;
+            mks.readHandle(hnd);
+            mks.result(filename);
+            total.m_bytes += mks.m_bytes;
+            std::fclose(hnd);
+        }
+        else
+        {
+            std::cerr << "failed to open \"" << filename << "\" for reading" << std::endl;
+            errc += 1;
+        }
+    }
+    if(cfg.total)
+    {
+        total.result("total");
+    }
+    return errc;
+}
 
 int main(int argc, char* argv[])
 {
-    int i;
     int errc;
-    std::string filename;
-    errc = 0;
-    if(argc > 1)
+    Config cfg;
+    OptionParser prs;
+    prs.on({"-j<n>", "--threads=<n>"}, "sum up files on <n> threads, splitting large files into chunks (0 means one per core)", [&](auto& v)
     {
-        for(i=1; i<argc; i++)
+        int n;
+        n = std::stoi(v.str());
+        if(n < 0)
         {
-            filename = argv[i];
-            std::fstream hnd(filename, std::ios::in | std::ios::binary);
-            if(hnd.good())
-            {
-                doHandle(hnd, filename);
-            }
-            else
-            {
-                std::cerr << "failed to open \"" << filename << "\" for reading" << std::endl;
-                errc += 1;
-            }
+            throw std::runtime_error("invalid thread count '" + v.str() + "'");
+        }
+        cfg.threads = n;
+        if(cfg.threads == 0)
+        {
+            cfg.threads = std::max(1u, std::thread::hardware_concurrency());
         }
+    });
+    prs.on({"-c", "--total"}, "print a grand total after the per-file results", [&]
+    {
+        cfg.total = true;
+    });
+    try
+    {
+        prs.parse(argc, argv);
+    }
+    catch(std::exception& e)
+    {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 1;
+    }
+    auto files = prs.positional();
+    if(files.empty())
+    {
+        MkSum mks;
+        mks.readHandle(stdin);
+        mks.result("<stdin>");
+        return 0;
+    }
+    if(cfg.threads > 1)
+    {
+        errc = sumParallel(files, cfg);
     }
     else
     {
-        doHandle(std::cin, "<stdin>");
+        errc = sumSequential(files, cfg);
     }
     return ((errc > 0) ? 1 : 0);
 }
-
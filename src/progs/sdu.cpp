@@ -12,12 +12,21 @@
 #include <set>
 #include <functional>
 #include <string>
+#include <unordered_map>
+#include <queue>
+#include <mutex>
 #include <cstdio>
 #if defined(_WIN32)
     #include <io.h>
     #include <fcntl.h>
 #endif
 #include "shared.h"
+#include "linereader.h"
+#include "mappedfile.h"
+#include "outbuffer.h"
+#include "inodeset.h"
+#include "pathtree.h"
+#include "walkstats.h"
 #include "find.hpp"
 #include "optionparser.hpp"
 
@@ -27,128 +36,527 @@ struct Config
     bool readstdin = false;
     bool recursive = false;
     bool printbytes = false;
+    // whether paths read via '-i' or '-f' are NUL-separated
+    bool nulsep = false;
     size_t max_depth = 0;
+    size_t threads = 1;
+    // getdents hands out sizes from the one stat it does per file anyway
+    #if defined(__linux__)
+        Find::Finder::Backend backend = Find::Finder::Backend::Getdents;
+    #else
+        Find::Finder::Backend backend = Find::Finder::Backend::Standard;
+    #endif
     std::optional<std::string> filepath = {};
+    // if not empty, directories that haven't changed since the last run are replayed from this file
+    std::string indexfile;
+    // skip whatever .gitignore and .ignore files say to skip
+    bool gitignore = false;
+    // print directory totals as soon as their subtree is done, and forget about them
+    bool stream = false;
+    // if not 0, only the largest $topk items are kept (and printed)
+    size_t topk = 0;
+    // count hard-linked files once per link, rather than once per inode
+    bool countlinks = false;
+    // print the allocated size as well
+    bool showalloc = false;
+    // don't cross into other filesystems
+    bool onefs = false;
+    // if not 0, mounts on which reading a directory takes longer than this many milliseconds are skipped
+    size_t mountbudget = 0;
+    // walk slow mounts last, instead of skipping them
+    bool deferslow = false;
+    // print what the walker did to stderr once done (as JSON with $statsjson)
+    bool stats = false;
+    bool statsjson = false;
+    // if not empty, a Chrome trace of the walks is written to this file
+    std::string tracefile;
+    // if not 0, this many of the slowest directories are printed to stderr
+    size_t slowest = 0;
 };
 
 struct Program
 {
+    /*
+    * what is added up: the apparent size (what 'ls -l' shows), and what the
+    * files actually take up on disk (which differs for sparse files, and small ones).
+    */
+    struct Sizes
+    {
+        uint64_t apparent = 0;
+        uint64_t allocated = 0;
+
+        void add(const Sizes& other)
+        {
+            apparent += other.apparent;
+            allocated += other.allocated;
+        }
+    };
+
     struct Item
     {
         bool isdirectory = false;
-        size_t sizebytes = 0;
-        std::filesystem::path path;
+        Sizes size;
+        // the node in $tree, if the item has one; its path is only built when it's printed
+        size_t node = Shared::PathTree::NoNode;
+        std::string path;
+    };
+
+    // orders the top-k heap so that the smallest item is on top, and gets dropped first
+    struct LargerSize
+    {
+        bool operator()(const Item& lhs, const Item& rhs) const
+        {
+            return (lhs.size.apparent > rhs.size.apparent);
+        }
+    };
+
+    /*
+    * a directory that has been walked; nodes[i] belongs to tree node i, which holds
+    * its name and parent.
+    * a node is always added before the nodes of its subdirectories, so
+    * tree.parent(i) < i, which is what lets sumTree() add everything up bottom-up
+    * in a single backwards pass.
+    */
+    struct DirNode
+    {
+        // relative to the directory the walk started in
+        size_t depth = 0;
+        // sum of the files directly inside this directory
+        Sizes own;
+        // $own plus the totals of all subdirectories
+        Sizes total;
+    };
+
+    /*
+    * a directory of a tree walked with '--stream'.
+    * unlike DirNode, this only exists while the walk is inside the subtree: once the
+    * directory itself, and all of its subdirectories are done, its total is final,
+    * gets printed, added to the parent, and the node is removed. so the number of nodes
+    * is bounded by the directories that are being walked, not by the size of the tree.
+    */
+    struct StreamNode
+    {
+        StreamNode* parent = nullptr;
+        // the key of this node in streamnodes
+        const std::string* path = nullptr;
+        size_t depth = 0;
+        // 1 for the directory itself, plus 1 for each subdirectory whose subtree isn't done yet
+        size_t pending = 1;
+        Sizes total;
     };
 
+    static constexpr size_t NoParent = Shared::PathTree::NoNode;
+
     Config cfg;
     std::vector<Item> items;
+    std::priority_queue<Item, std::vector<Item>, LargerSize> topitems;
+    std::vector<DirNode> nodes;
+    Shared::PathTree tree;
+    std::unordered_map<std::string, StreamNode> streamnodes;
+    Find::DirIndex dirindex;
+    // every hard-linked file counted so far
+    Shared::InodeSet inodes;
+    Shared::BufferedWriter out;
+    std::string linebuf;
+    // added up over all walks
+    Find::WalkStats walkstats;
+    // only set if a trace, or the slowest directories, were asked for
+    std::unique_ptr<Find::Tracer> tracer;
 
-    Program(Config c): cfg(c)
+    Program(Config c): cfg(c), out(stdout)
     {
+        if(!cfg.indexfile.empty())
+        {
+            dirindex.load(cfg.indexfile);
+        }
+        if(!cfg.tracefile.empty() || (cfg.slowest > 0))
+        {
+            tracer.reset(new Find::Tracer(1024 * 256, std::max(cfg.slowest, size_t(1))));
+        }
     }
 
-    void printItem(const Item& it)
+    void appendSize(uint64_t bytes)
     {
         if(cfg.printbytes)
         {
-            std::cout << it.sizebytes;
+            linebuf.append(std::to_string(bytes));
         }
         else
         {
-            std::cout << Shared::sizeToReadable(it.sizebytes, 2);
+            linebuf.append(Shared::sizeToReadable(bytes, 2));
+        }
+        linebuf.push_back('\t');
+    }
+
+    void printItem(const Item& it)
+    {
+        linebuf.clear();
+        appendSize(it.size.apparent);
+        if(cfg.showalloc)
+        {
+            appendSize(it.size.allocated);
+        }
+        if(it.node != Shared::PathTree::NoNode)
+        {
+            tree.append(it.node, linebuf);
+        }
+        else
+        {
+            linebuf.append(it.path);
         }
-        std::cout << "\t" << it.path.string();
         if(it.isdirectory)
         {
-            std::cout << "/";
+            linebuf.push_back('/');
         }
-        std::cout << std::endl << std::flush;
+        out.writeRecord(linebuf, '\n');
     }
 
+    // prints whatever was held back for sorting, smallest first
     void printSorted()
     {
+        while(!topitems.empty())
+        {
+            items.push_back(topitems.top());
+            topitems.pop();
+        }
         std::sort(items.begin(), items.end(), [](const Item& lhs, const Item& rhs)
         {
-            return (lhs.sizebytes < rhs.sizebytes);
+            return (lhs.size.apparent < rhs.size.apparent);
         });
         for(auto& it: items)
         {
             printItem(it);
         }
+        items.clear();
     }
 
-    void finder(const std::filesystem::path& path, size_t maxdepth, bool onlyfiles, std::function<void(const std::filesystem::path&)> fn)
+    void finish()
     {
-        Find::Finder fi(path);
-        if(maxdepth != 0)
+        if(cfg.sort || (cfg.topk > 0))
         {
-            fi.setMaxDepth(maxdepth);
+            printSorted();
         }
-        fi.onException([&](const std::exception& ex, const std::string& orig, const std::filesystem::path& p)
+        out.flush();
+        // only if anything was walked at all
+        if(cfg.stats && (walkstats.threads > 0))
         {
-            std::string exmsg;
-            exmsg = ex.what();
-            exmsg.erase(std::remove(exmsg.begin(), exmsg.end(), '\r'), exmsg.end());
-            exmsg.erase(std::remove(exmsg.begin(), exmsg.end(), '\n'), exmsg.end());
-            std::cerr << "ERROR: in '" << orig << "': path \"" << p.string() << "\": " << exmsg << std::endl;
-        });
-        if(onlyfiles)
+            Shared::printWalkStats(std::cerr, walkstats, cfg.statsjson);
+        }
+        if(tracer && (walkstats.threads > 0))
+        {
+            if(cfg.slowest > 0)
+            {
+                Shared::printSlowest(std::cerr, *tracer, cfg.slowest);
+            }
+            if(!cfg.tracefile.empty() && !tracer->writeChromeTrace(cfg.tracefile))
+            {
+                std::cerr << "failed to write trace \"" << cfg.tracefile << "\"" << std::endl;
+            }
+        }
+    }
+
+    // the bytes of $dir without a copy, where the platform allows it ($tmp is only used on windows)
+    static std::string_view dirBytes(const std::filesystem::path& dir, std::string& tmp)
+    {
+        #if defined(_WIN32)
+            tmp = dir.string();
+            return tmp;
+        #else
+            (void)tmp;
+            return dir.native();
+        #endif
+    }
+
+    // $name is the whole path of a root, and just the name of anything else
+    size_t addNode(std::string_view name, size_t parent, size_t depth)
+    {
+        DirNode node;
+        node.depth = depth;
+        nodes.push_back(node);
+        return tree.add(parent, name);
+    }
+
+    /*
+    * walks $root once, adding a node for every directory in it, and the size of
+    * every file to the node of the directory it's in. each file is stat'd exactly once,
+    * by the walker itself.
+    * directories that already have a node (because they were an earlier argument)
+    * are not walked again; their total is reused instead.
+    */
+    size_t walkTree(const std::filesystem::path& root)
+    {
+        size_t rootidx;
+        size_t lastidx;
+        std::string tmp;
+        std::string dirtmp;
+        std::string lastdir;
+        std::mutex mtx;
+        Find::Finder fi(root);
+        rootidx = addNode(root.string(), NoParent, 0);
+        lastidx = rootidx;
+        lastdir = root.string();
+        setupFinder(fi);
+        // only directories from earlier trees can be known before the walk gets to them
+        if(rootidx > 0)
         {
-            fi.skipItemIf([&](const std::filesystem::path& checkthis, bool isdir, bool isfile)
+            fi.pruneIf([&](const std::filesystem::path& checkthis)
             {
-                (void)checkthis;
-                (void)isfile;
-                return isdir;
+                size_t known;
+                size_t parent;
+                std::lock_guard<std::mutex> lock(mtx);
+                known = tree.find(checkthis.string());
+                if((known == NoParent) || (known >= rootidx))
+                {
+                    return false;
+                }
+                parent = tree.find(checkthis.parent_path().string());
+                if(parent != NoParent)
+                {
+                    nodes[parent].own.add(nodes[known].total);
+                }
+                return true;
             });
         }
-        fi.walk(fn);
+        fi.walkEntries([&](const Find::Finder::Entry& ent)
+        {
+            Sizes sz;
+            std::string_view dirb;
+            // the inode set has locks of its own
+            if(ent.isfile && ent.hasstat)
+            {
+                sz = countFile(ent.stat);
+            }
+            std::lock_guard<std::mutex> lock(mtx);
+            // entries of the same directory usually come in one go, so this rarely has to copy or look anything up
+            dirb = dirBytes(ent.dir, dirtmp);
+            if(dirb != lastdir)
+            {
+                lastdir.assign(dirb);
+                lastidx = tree.find(lastdir);
+            }
+            if(ent.isdir && (!ent.islink))
+            {
+                addNode(Find::Detail::baseName(ent.pathBytes(tmp)), lastidx, ent.depth);
+            }
+            else
+            {
+                nodes[lastidx].own.add(sz);
+            }
+        });
+        walkstats.merge(fi.stats());
+        reportSlowMounts(fi);
+        sumTree(rootidx);
+        return rootidx;
     }
 
-    size_t sizeOfFile(const std::filesystem::path& path)
+    void reportSlowMounts(Find::Finder& fi)
     {
-        //std::cerr << "sizeOfFile(" << path << ")" << std::endl;
-        if(std::filesystem::is_regular_file(path))
+        for(const auto& slow: fi.slowMounts())
         {
-            return std::filesystem::file_size(path);
+            std::cerr << "note: the mount of \"" << slow.string() << "\" is slow; "
+                      << (cfg.deferslow ? "it was walked last" : "the rest of it was skipped") << std::endl;
         }
-        return 0;
     }
 
-    size_t sizeOfDirectory(const std::filesystem::path& dirn)
+    /*
+    * the sizes a file adds to the total, as per the stat data the walker got anyway -
+    * nothing, if it's a hard link to a file that has been counted before.
+    * only files with more than one link need to go into the set.
+    */
+    Sizes countFile(const Find::StatInfo& st)
     {
-        size_t sz;
-        sz = 0;
-        finder(dirn, 0, true, [&](const std::filesystem::path& path)
+        Sizes sz;
+        if((!cfg.countlinks) && (st.nlink > 1) && (!inodes.insert(st.dev, st.ino)))
         {
-            size_t r;
-            r = sizeOfFile(path);
-            //std::cerr << "sizeOfDirectory:path=" << path << ", size=" << r << std::endl;
-            sz += r;
-        });
+            return sz;
+        }
+        sz.apparent = st.size;
+        sz.allocated = st.allocated;
         return sz;
     }
 
-    void handleItem(const std::filesystem::path& fs)
+    // what walkTree() and walkStreaming() have in common
+    void setupFinder(Find::Finder& fi)
     {
-        Item it;
-        it.path = fs;
-        if(std::filesystem::is_regular_file(fs))
+        fi.setThreads(cfg.threads);
+        fi.setBackend(cfg.backend);
+        fi.setWantStat(true);
+        if(cfg.gitignore)
         {
-            it.sizebytes = sizeOfFile(it.path);
+            fi.setIgnoreFiles({".gitignore", ".ignore"});
         }
-        else if(std::filesystem::is_directory(fs))
+        fi.setOneFilesystem(cfg.onefs);
+        fi.setMountBudget(std::chrono::milliseconds(cfg.mountbudget), cfg.deferslow);
+        fi.setTimeStats(cfg.stats);
+        fi.setTracer(tracer.get());
+        if(!cfg.indexfile.empty())
         {
-            it.isdirectory = true;
-            it.sizebytes = sizeOfDirectory(it.path);
+            fi.setIndex(&dirindex);
         }
-        else
+        fi.onError([&](const Find::Finder::WalkError& err)
         {
-            std::cerr << "not a file or directory: " << fs << std::endl;
-            return;
+            std::string msg;
+            msg = Find::Finder::ErrorMessage(err);
+            msg.erase(std::remove(msg.begin(), msg.end(), '\r'), msg.end());
+            msg.erase(std::remove(msg.begin(), msg.end(), '\n'), msg.end());
+            std::cerr << "ERROR: in '" << Find::Finder::PhaseName(err.phase) << "': path \"" << err.path.string() << "\": " << msg << std::endl;
+        });
+    }
+
+    /*
+    * takes one pending count off $node. if that was the last one, its subtree is done:
+    * with '-r', it's printed right away, its total goes to its parent (which may be
+    * done now as well), and it's removed. once the root is done, its total is stored in $roottotal.
+    */
+    void finishNode(StreamNode* node, Sizes& roottotal)
+    {
+        Sizes total;
+        StreamNode* parent;
+        while(node != nullptr)
+        {
+            node->pending--;
+            if(node->pending > 0)
+            {
+                break;
+            }
+            parent = node->parent;
+            total = node->total;
+            if(parent != nullptr)
+            {
+                parent->total.add(total);
+                if(cfg.recursive && ((cfg.max_depth == 0) || (node->depth <= cfg.max_depth)))
+                {
+                    Item it;
+                    it.isdirectory = true;
+                    it.size = total;
+                    it.path = *node->path;
+                    emitItem(std::move(it));
+                }
+            }
+            else
+            {
+                roottotal = total;
+            }
+            streamnodes.erase(streamnodes.find(*node->path));
+            node = parent;
         }
-        if(cfg.sort)
+    }
+
+    /*
+    * walks $root like walkTree() does, but only keeps the directories the walk is
+    * currently inside of - see StreamNode. with '-r', subdirectories are printed as
+    * soon as they're done, before their parents, like du does.
+    * trees walked this way can't be reused by later arguments.
+    * returns the total of $root.
+    */
+    Sizes walkStreaming(const std::filesystem::path& root)
+    {
+        Sizes roottotal;
+        std::string tmp;
+        std::string dirtmp;
+        std::string lastdir;
+        std::mutex mtx;
+        StreamNode* lastnode;
+        Find::Finder fi(root);
+        lastdir = root.string();
+        auto rootent = streamnodes.try_emplace(lastdir);
+        lastnode = &rootent.first->second;
+        lastnode->path = &rootent.first->first;
+        setupFinder(fi);
+        fi.onDirectoryDone([&](const std::filesystem::path& dir, size_t, size_t)
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto it = streamnodes.find(dir.string());
+            if(it != streamnodes.end())
+            {
+                finishNode(&it->second, roottotal);
+            }
+        });
+        fi.walkEntries([&](const Find::Finder::Entry& ent)
         {
-            items.push_back(it);
+            Sizes sz;
+            std::string_view dirb;
+            if(ent.isfile && ent.hasstat)
+            {
+                sz = countFile(ent.stat);
+            }
+            std::lock_guard<std::mutex> lock(mtx);
+            // $lastnode may have been removed by now - but then, no more entries of $lastdir will show up
+            dirb = dirBytes(ent.dir, dirtmp);
+            if(dirb != lastdir)
+            {
+                lastdir.assign(dirb);
+                lastnode = &streamnodes.at(lastdir);
+            }
+            if(ent.isdir && (!ent.islink))
+            {
+                auto child = streamnodes.try_emplace(std::string(ent.pathBytes(tmp)));
+                child.first->second.parent = lastnode;
+                child.first->second.path = &child.first->first;
+                child.first->second.depth = ent.depth;
+                lastnode->pending++;
+            }
+            else
+            {
+                lastnode->total.add(sz);
+            }
+        });
+        walkstats.merge(fi.stats());
+        reportSlowMounts(fi);
+        // only if a directory was reported, but never read - which the walker doesn't do
+        streamnodes.clear();
+        return roottotal;
+    }
+
+    // adds up the totals of every node from $rootidx onwards, bottom-up
+    void sumTree(size_t rootidx)
+    {
+        size_t i;
+        for(i=rootidx; i<nodes.size(); i++)
+        {
+            nodes[i].total = nodes[i].own;
+        }
+        for(i=nodes.size()-1; i>rootidx; i--)
+        {
+            nodes[tree.parent(i)].total.add(nodes[i].total);
+        }
+    }
+
+    // the node of $dirn, walking it if it hasn't been walked yet
+    size_t treeIndex(const std::filesystem::path& dirn)
+    {
+        size_t idx;
+        idx = tree.find(dirn.string());
+        if(idx != NoParent)
+        {
+            return idx;
+        }
+        return walkTree(dirn);
+    }
+
+    Sizes sizeOfFile(const std::filesystem::path& path)
+    {
+        Find::StatInfo st;
+        if(!Find::Detail::statPath(path, st))
+        {
+            return Sizes{};
+        }
+        return countFile(st);
+    }
+
+    void emitItem(Item&& it)
+    {
+        if(cfg.topk > 0)
+        {
+            topitems.push(std::move(it));
+            if(topitems.size() > cfg.topk)
+            {
+                topitems.pop();
+            }
+        }
+        else if(cfg.sort)
+        {
+            items.push_back(std::move(it));
         }
         else
         {
@@ -156,32 +564,108 @@ struct Program
         }
     }
 
-    template<typename StreamT>
-    bool readStream(StreamT& fh)
+    /*
+    * with '-r', also report every directory below $idx, down to '-d' levels.
+    * a node is below $idx if its parent is $idx, or is itself below $idx - and since
+    * parents come first, one forward pass over the nodes finds all of them.
+    */
+    void emitSubdirs(size_t idx)
     {
-        std::string line;
-        line.reserve(1024 * 8);
-        while(std::getline(fh, line))
+        size_t i;
+        size_t parent;
+        size_t reldepth;
+        std::vector<bool> below(nodes.size() - idx, false);
+        below[0] = true;
+        for(i=idx+1; i<nodes.size(); i++)
         {
-            handleItem(line);
-            line.clear();
+            const auto& node = nodes[i];
+            parent = tree.parent(i);
+            if((parent == NoParent) || (parent < idx) || (!below[parent - idx]))
+            {
+                continue;
+            }
+            below[i - idx] = true;
+            reldepth = (node.depth - nodes[idx].depth);
+            if((cfg.max_depth == 0) || (reldepth <= cfg.max_depth))
+            {
+                Item it;
+                it.isdirectory = true;
+                it.size = node.total;
+                it.node = i;
+                emitItem(std::move(it));
+            }
+        }
+    }
+
+    void handleItem(const std::filesystem::path& fs)
+    {
+        Item it;
+        size_t idx;
+        std::error_code ec;
+        auto status = std::filesystem::status(fs, ec);
+        it.path = fs.string();
+        if(std::filesystem::is_regular_file(status))
+        {
+            it.size = sizeOfFile(fs);
+            emitItem(std::move(it));
+        }
+        else if(cfg.stream && std::filesystem::is_directory(status))
+        {
+            it.isdirectory = true;
+            it.size = walkStreaming(fs);
+            emitItem(std::move(it));
+        }
+        else if(std::filesystem::is_directory(status))
+        {
+            idx = treeIndex(fs);
+            it.isdirectory = true;
+            it.size = nodes[idx].total;
+            emitItem(std::move(it));
+            if(cfg.recursive)
+            {
+                emitSubdirs(idx);
+            }
+        }
+        else
+        {
+            std::cerr << "not a file or directory: " << fs << std::endl;
+        }
+    }
+
+    bool readStream(FILE* fh)
+    {
+        std::string_view line;
+        Shared::LineReader rd(fh, (cfg.nulsep ? '\0' : '\n'));
+        while(rd.next(line))
+        {
+            handleItem(std::filesystem::path(line.begin(), line.end()));
         }
         return true;
     }
 
     bool readStdin()
     {
-        return readStream(std::cin);
+        return readStream(stdin);
     }
 
+    /*
+    * the listing is mapped into memory rather than read.
+    * the paths in it are still handled one after the other: the directories among
+    * them are walked with '-j' threads already, and share one tree.
+    */
     bool readFile()
     {
-        std::fstream fh(cfg.filepath.value(), std::ios::in | std::ios::binary);
-        if(fh.good())
+        Shared::MappedFile mf;
+        if(!mf.open(cfg.filepath.value()))
         {
-            readStream(fh);
+            std::cerr << "failed to open \"" << cfg.filepath.value() << "\" for reading" << std::endl;
+            return false;
         }
-        return false;
+        Shared::forEachLine(mf.view(), (cfg.nulsep ? '\0' : '\n'), [&](std::string_view line)
+        {
+            handleItem(std::filesystem::path(line.begin(), line.end()));
+        });
+        return true;
     }
 
     bool readDir(const std::string& dirn)
@@ -219,6 +703,10 @@ struct Program
             {
                 readDir(".");
             }
+            if(!cfg.indexfile.empty() && !dirindex.save(cfg.indexfile))
+            {
+                std::cerr << "failed to write index \"" << cfg.indexfile << "\"" << std::endl;
+            }
         }
         return true;
     }
@@ -236,6 +724,10 @@ int main(int argc, char* argv[])
     {
         cfg.readstdin = true;
     });
+    prs.on({"-0", "--null"}, "paths read via -i or -f are NUL-separated (as written by 'find -print0')", [&]
+    {
+        cfg.nulsep = true;
+    });
     prs.on({"-f<file>", "--file=<file>"}, "read filepaths from <file>", [&](auto& v)
     {
         cfg.filepath = v.str();
@@ -244,7 +736,61 @@ int main(int argc, char* argv[])
     {
         cfg.max_depth = std::stoi(v.str());
     });
-    prs.on({"-r", "--recursive"}, "recurse directories", [&]
+    prs.on({"-j<n>", "--threads=<n>"}, "number of threads used to walk directories (0 means one per core)", [&](auto& v)
+    {
+        int n;
+        n = std::stoi(v.str());
+        if(n < 0)
+        {
+            throw std::runtime_error("invalid thread count '" + v.str() + "'");
+        }
+        cfg.threads = n;
+    });
+    prs.on({"-B<name>", "--backend=<name>"}, "how to read directories ('std', 'getdents' or 'uring')", [&](auto& v)
+    {
+        if(!Find::Finder::BackendFromString(v.str(), cfg.backend))
+        {
+            throw std::runtime_error("unknown backend '" + v.str() + "'");
+        }
+    });
+    prs.on({"-I<file>", "--index=<file>"}, "keep a directory index in <file>, and only re-read directories that changed since the last run", [&](auto& v)
+    {
+        cfg.indexfile = v.str();
+    });
+    prs.on({"-G", "--gitignore"}, "skip files and directories ignored by .gitignore and .ignore files (and .git directories)", [&]
+    {
+        cfg.gitignore = true;
+    });
+    prs.on({"-S", "--stream"}, "print directory totals as soon as they're done, keeping only the directories being walked in memory (implies -s)", [&]
+    {
+        cfg.stream = true;
+        cfg.sort = false;
+    });
+    prs.on({"-t<k>", "--top=<k>"}, "only keep, and print, the <k> largest items (sorted). with -S, memory use doesn't grow with the tree", [&](auto& v)
+    {
+        cfg.topk = std::stoi(v.str());
+    });
+    prs.on({"-l", "--count-links"}, "count hard-linked files once per link (by default, every inode is only counted once)", [&]
+    {
+        cfg.countlinks = true;
+    });
+    prs.on({"-A", "--allocated"}, "also print the allocated size (what is actually used on disk), after the apparent size", [&]
+    {
+        cfg.showalloc = true;
+    });
+    prs.on({"-x", "--one-file-system"}, "do not descend into directories on other filesystems", [&]
+    {
+        cfg.onefs = true;
+    });
+    prs.on({"-M<ms>", "--mount-budget=<ms>"}, "skip the rest of a mount once reading one of its directories took longer than <ms> milliseconds", [&](auto& v)
+    {
+        cfg.mountbudget = std::stoi(v.str());
+    });
+    prs.on({"-D", "--defer-slow"}, "with -M, walk slow mounts last instead of skipping them", [&]
+    {
+        cfg.deferslow = true;
+    });
+    prs.on({"-r", "--recursive"}, "also print the totals of subdirectories (down to --depth levels)", [&]
     {
         cfg.recursive = true;
     });
@@ -252,16 +798,30 @@ int main(int argc, char* argv[])
     {
         cfg.printbytes = true;
     });
+    prs.on({"-T", "--stats"}, "print what the directory walker did (directories, entries, stat calls, time per phase) to stderr", [&]
+    {
+        cfg.stats = true;
+    });
+    prs.on({"-J", "--stats-json"}, "like --stats, but as a JSON object", [&]
+    {
+        cfg.stats = true;
+        cfg.statsjson = true;
+    });
+    prs.on({"-W<file>", "--trace=<file>"}, "write a timeline of the walk, per thread, to <file> (Chrome trace format; open in ui.perfetto.dev)", [&](auto& v)
+    {
+        cfg.tracefile = v.str();
+    });
+    prs.on({"-K<n>", "--slowest=<n>"}, "print the <n> directories that took the longest to read to stderr", [&](auto& v)
+    {
+        cfg.slowest = std::stoi(v.str());
+    });
     try
     {
         prs.parse(argc, argv);
         Program pg(cfg);
         if(pg.main(prs.positional()))
         {
-            if(cfg.sort)
-            {
-                pg.printSorted();
-            }
+            pg.finish();
             return 0;
         }
         return 1;
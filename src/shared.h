@@ -5,6 +5,7 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <map>
 #include <array>
 #include <cmath>
@@ -19,4 +20,91 @@ namespace Shared
     }
 
     std::string sizeToReadable(double len, int precision=0);
+
+    /*
+    * the path splitting that std::filesystem::path does in filename(), extension() and stem(),
+    * done directly on the bytes of a path instead, so that it never allocates.
+    * the results are slices of the input, and follow the same rules as std::filesystem -
+    * including that "foo/" has the filename ".", and that ".bashrc" is all extension, and no stem.
+    */
+    constexpr bool isPathSeparator(char ch)
+    {
+        #if defined(_WIN32)
+            return ((ch == '/') || (ch == '\\'));
+        #else
+            return (ch == '/');
+        #endif
+    }
+
+    inline std::string_view pathFilename(std::string_view path)
+    {
+        size_t pos;
+        if(path.empty())
+        {
+            return path;
+        }
+        pos = path.size();
+        if(isPathSeparator(path[pos - 1]))
+        {
+            while((pos > 0) && isPathSeparator(path[pos - 1]))
+            {
+                pos--;
+            }
+            // the root directory is its own filename
+            if(pos == 0)
+            {
+                return path.substr(0, 1);
+            }
+            return std::string_view(".");
+        }
+        while((pos > 0) && !isPathSeparator(path[pos - 1]))
+        {
+            pos--;
+        }
+        return path.substr(pos);
+    }
+
+    // position of the extension within $filename, or $filename.size() if it hasn't any
+    inline size_t extensionPos(std::string_view filename)
+    {
+        size_t pos;
+        if((filename == ".") || (filename == ".."))
+        {
+            return filename.size();
+        }
+        pos = filename.rfind('.');
+        if(pos == std::string_view::npos)
+        {
+            return filename.size();
+        }
+        return pos;
+    }
+
+    inline std::string_view pathExtension(std::string_view path)
+    {
+        auto filename = pathFilename(path);
+        return filename.substr(extensionPos(filename));
+    }
+
+    inline std::string_view pathStem(std::string_view path)
+    {
+        auto filename = pathFilename(path);
+        return filename.substr(0, extensionPos(filename));
+    }
+
+    /*
+    * lowercases the ascii letters of $src into $dest, which must hold at least $src.size() bytes.
+    * same as ::tolower() in the "C" locale, minus the function call per byte.
+    */
+    inline std::string_view asciiLower(std::string_view src, char* dest)
+    {
+        size_t i;
+        char ch;
+        for(i=0; i<src.size(); i++)
+        {
+            ch = src[i];
+            dest[i] = (((ch >= 'A') && (ch <= 'Z')) ? char(ch + ('a' - 'A')) : ch);
+        }
+        return std::string_view(dest, src.size());
+    }
 }
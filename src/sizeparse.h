@@ -0,0 +1,188 @@
+
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstdlib>
+
+namespace Shared
+{
+    /*
+    * the multiplier of every unit character ('B', 'K', 'M', ..., in either case),
+    * indexed by the character itself. 0 marks characters that aren't units.
+    */
+    struct UnitTable
+    {
+        int64_t mult[256];
+    };
+
+    constexpr UnitTable makeUnitTable()
+    {
+        UnitTable tab = {};
+        const char units[] = "BKMGTPE";
+        int64_t mult = 1;
+        int i = 0;
+        for(i=0; units[i] != 0; i++)
+        {
+            // 'E' (1024^6) is the last multiplier that fits into an int64_t
+            if(i > 0)
+            {
+                mult *= 1024;
+            }
+            tab.mult[(unsigned char)units[i]] = mult;
+            tab.mult[(unsigned char)(units[i] + ('a' - 'A'))] = mult;
+        }
+        return tab;
+    }
+
+    inline constexpr UnitTable unitTable = makeUnitTable();
+
+    /*
+    * a number like "1.07", kept as 107 and 2 fraction digits, so that it can be
+    * turned into bytes with integer arithmetic.
+    */
+    struct ParsedSize
+    {
+        uint64_t mantissa = 0;
+        int fracdigits = 0;
+
+        // false if the number had too many digits to fit $mantissa; $approx is still valid then
+        bool exact = true;
+
+        double approx = 0;
+        int64_t unit = 0;
+        char unitch = 0;
+    };
+
+    enum class SizeParseStatus
+    {
+        Ok,
+
+        // the line is empty, or only whitespace
+        Empty,
+
+        // the line doesn't begin with a number
+        NoNumber,
+
+        // the number isn't followed by a known unit character. see ParsedSize::unitch
+        BadUnit,
+    };
+
+    /*
+    * parses the size at the start of a line of 'du -h' (or sdu) output, like "1.07M\tfoo".
+    * leading whitespace is skipped, the number is read digit by digit, and the unit
+    * looked up in unitTable - no allocations, no locale, and no strtod() unless the
+    * number has more digits than a 64-bit integer holds.
+    * like std::stod(), the number is the longest valid prefix of the run of digits and
+    * dots, i.e., "1.2.3K" reads as 1.2 kilobytes.
+    */
+    inline SizeParseStatus parseSizeLine(std::string_view line, ParsedSize& dest)
+    {
+        static constexpr double pow10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+            1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+        };
+        size_t ofs;
+        size_t begin;
+        size_t ndigits;
+        bool seendot;
+        unsigned char ch;
+        dest = ParsedSize{};
+        ofs = 0;
+        while((ofs < line.size()) && ((line[ofs] == ' ') || ((line[ofs] >= '\t') && (line[ofs] <= '\r'))))
+        {
+            ofs++;
+        }
+        if(ofs == line.size())
+        {
+            return SizeParseStatus::Empty;
+        }
+        begin = ofs;
+        ndigits = 0;
+        seendot = false;
+        while(ofs < line.size())
+        {
+            ch = line[ofs];
+            if((ch >= '0') && (ch <= '9'))
+            {
+                if(ndigits < 19)
+                {
+                    dest.mantissa = ((dest.mantissa * 10) + (ch - '0'));
+                    dest.fracdigits += (seendot ? 1 : 0);
+                }
+                else
+                {
+                    dest.exact = false;
+                }
+                ndigits++;
+            }
+            else if((ch == '.') && !seendot)
+            {
+                seendot = true;
+            }
+            else
+            {
+                break;
+            }
+            ofs++;
+        }
+        if(ndigits == 0)
+        {
+            return SizeParseStatus::NoNumber;
+        }
+        if(dest.exact)
+        {
+            // exact as long as the mantissa fits a double's 53 bits, which covers anything du prints
+            dest.approx = (double(dest.mantissa) / pow10[dest.fracdigits]);
+        }
+        else
+        {
+            std::string tmp(line.substr(begin, ofs - begin));
+            dest.approx = std::strtod(tmp.c_str(), nullptr);
+        }
+        // skip the rest of something like "1.2.3"
+        while((ofs < line.size()) && (((line[ofs] >= '0') && (line[ofs] <= '9')) || (line[ofs] == '.')))
+        {
+            ofs++;
+        }
+        dest.unitch = ((ofs < line.size()) ? line[ofs] : 0);
+        dest.unit = unitTable.mult[(unsigned char)dest.unitch];
+        if(dest.unit == 0)
+        {
+            return SizeParseStatus::BadUnit;
+        }
+        return SizeParseStatus::Ok;
+    }
+
+    /*
+    * the number of bytes $ps stands for, rounded down - computed from the integer
+    * mantissa, so the result doesn't depend on floating point rounding, and sums of
+    * it are the same no matter in which order (or on how many threads) they're added up.
+    * this is what the old 'm_bytes += (dval * unit)' did as well, since adding a double
+    * to an integer truncates it.
+    */
+    inline int64_t sizeToBytes(const ParsedSize& ps)
+    {
+        static constexpr uint64_t pow10[] = {
+            1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+            100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+            10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+            100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull,
+        };
+        if(!ps.exact)
+        {
+            return (ps.approx * ps.unit);
+        }
+        #if defined(__SIZEOF_INT128__)
+            // mantissa < 10^19 < 2^64, and unit <= 2^60, so this can't overflow
+            return int64_t((unsigned __int128)(ps.mantissa) * uint64_t(ps.unit) / pow10[ps.fracdigits]);
+        #else
+            uint64_t whole;
+            uint64_t frac;
+            whole = (ps.mantissa / pow10[ps.fracdigits]);
+            frac = (ps.mantissa % pow10[ps.fracdigits]);
+            // only exact as long as frac * unit fits - which it does for anything du prints
+            return int64_t((whole * ps.unit) + ((frac * ps.unit) / pow10[ps.fracdigits]));
+        #endif
+    }
+}
@@ -0,0 +1,74 @@
+
+#pragma once
+#include <ostream>
+#include <cstdio>
+#include "find.hpp"
+
+namespace Shared
+{
+    /*
+    * prints what Find::Finder::stats() returned (added up over all the walks of a program),
+    * either as a table for people to read, or as a single JSON object.
+    * times are in seconds; they are 0 unless the walks were timed (Finder::setTimeStats()).
+    */
+    inline void printWalkStats(std::ostream& os, const Find::WalkStats& st, bool json)
+    {
+        char buf[512];
+        auto secs = [](uint64_t ns)
+        {
+            return (double(ns) / 1e9);
+        };
+        if(json)
+        {
+            std::snprintf(buf, sizeof(buf),
+                "{\"enabled\": %s, \"threads\": %zu, \"dirs_opened\": %llu, \"dirs_reused\": %llu, \"entries\": %llu, "
+                "\"stat_calls\": %llu, \"statx_batched\": %llu, \"pruned\": %llu, \"errors\": %llu, \"path_bytes\": %llu, "
+                "\"open_s\": %.6f, \"read_s\": %.6f, \"callbacks_s\": %.6f, \"idle_s\": %.6f, \"walk_s\": %.6f}",
+                (FIND_STATS ? "true" : "false"), st.threads,
+                (unsigned long long)st.dirs_opened, (unsigned long long)st.dirs_reused, (unsigned long long)st.entries,
+                (unsigned long long)st.stat_calls, (unsigned long long)st.statx_batched, (unsigned long long)st.pruned,
+                (unsigned long long)st.errors, (unsigned long long)st.path_bytes,
+                secs(st.ns_open), secs(st.ns_read), secs(st.ns_callbacks), secs(st.ns_idle), secs(st.ns_walk));
+            os << buf << '\n';
+            return;
+        }
+        if(!FIND_STATS)
+        {
+            os << "walk stats: not available (built with FIND_STATS=0)" << '\n';
+            return;
+        }
+        std::snprintf(buf, sizeof(buf),
+            "walk stats (%zu thread%s, %.3fs):\n"
+            "  directories opened   %12llu\n"
+            "  directories reused   %12llu\n"
+            "  entries read         %12llu\n"
+            "  stat calls           %12llu\n"
+            "  statx via io_uring   %12llu\n"
+            "  subtrees pruned      %12llu\n"
+            "  errors               %12llu\n"
+            "  path bytes allocated %12llu\n"
+            "  time: open %.3fs, read %.3fs, callbacks %.3fs, idle %.3fs\n",
+            st.threads, ((st.threads == 1) ? "" : "s"), secs(st.ns_walk),
+            (unsigned long long)st.dirs_opened, (unsigned long long)st.dirs_reused, (unsigned long long)st.entries,
+            (unsigned long long)st.stat_calls, (unsigned long long)st.statx_batched, (unsigned long long)st.pruned,
+            (unsigned long long)st.errors, (unsigned long long)st.path_bytes,
+            secs(st.ns_open), secs(st.ns_read), secs(st.ns_callbacks), secs(st.ns_idle));
+        os << buf;
+    }
+
+    /*
+    * prints the $n directories that took the longest to read (including the callbacks
+    * for their entries), as recorded by $tr.
+    */
+    inline void printSlowest(std::ostream& os, const Find::Tracer& tr, size_t n)
+    {
+        char buf[64];
+        auto slow = tr.slowest(n);
+        os << "slowest directories:" << '\n';
+        for(const auto& sd: slow)
+        {
+            std::snprintf(buf, sizeof(buf), "  %10.6fs  [walker %zu]  ", (double(sd.duration) / 1e9), sd.thread);
+            os << buf << sd.path << '\n';
+        }
+    }
+}